@@ -0,0 +1,44 @@
+#include "AllocationCounter.h"
+#include <new>
+#include <stdlib.h>
+
+#ifdef ALLOC_COUNT
+
+// per thread, so that the asset loader workers importing in the background don't show up in the render thread's numbers
+// a plain integer needs no dynamic initialization, so operator new can touch it on any thread at any time
+static thread_local uint64_t allocationCount = 0;
+
+uint64_t AllocationCounter::GetCount()
+{
+	return allocationCount;
+}
+
+// replacing the plain forms is enough, the array and nothrow forms forward to them by default
+void* operator new(size_t size)
+{
+	allocationCount++;
+
+	void* p = malloc(size == 0 ? 1 : size);
+	if (p == NULL)
+		throw std::bad_alloc();
+	return p;
+}
+
+void operator delete(void* p) noexcept
+{
+	free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+	free(p);
+}
+
+#else
+
+uint64_t AllocationCounter::GetCount()
+{
+	return 0;
+}
+
+#endif
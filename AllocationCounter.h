@@ -0,0 +1,20 @@
+#pragma once
+#ifndef ALLOCATIONCOUNTER_H
+#define ALLOCATIONCOUNTER_H
+
+#include <stdint.h>
+
+// counts every global operator new, used to check that the steady-state frame does not touch the heap
+// on in debug builds, define ALLOC_COUNT to get it in release as well
+#if defined(_DEBUG) && !defined(ALLOC_COUNT)
+#define ALLOC_COUNT
+#endif
+
+class AllocationCounter
+{
+public:
+	// heap allocations made by the calling thread since it started, always 0 when ALLOC_COUNT is not defined
+	static uint64_t GetCount();
+};
+
+#endif
@@ -0,0 +1,151 @@
+#include "AssetLoader.h"
+#include "Profiler.h"
+#include <chrono>
+#include <float.h>
+
+AssetLoader* AssetLoader::loaderInstance = 0;
+
+AssetLoader::AssetLoader() : importing(0), stopping(false), hasUploading(false) { }
+
+AssetLoader* AssetLoader::GetInstance()
+{
+	if (!loaderInstance)
+		loaderInstance = new AssetLoader;
+	return loaderInstance;
+}
+
+void AssetLoader::StartWorkers()
+{
+	// leave one core to the render thread, which keeps running while the level loads
+	unsigned int count = std::thread::hardware_concurrency();
+	count = count > 1 ? count - 1 : 1;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = false;
+	}
+
+	for (unsigned int i = 0; i < count; i++)
+		workers.push_back(std::thread(&AssetLoader::WorkerLoop, this));
+}
+
+void AssetLoader::LoadModelAsync(const std::shared_ptr<Model>& model, const std::string& path)
+{
+	if (workers.empty())
+		StartWorkers();
+
+	Job job;
+	job.model = model;
+	job.path = path;
+	job.data = NULL;
+	job.textureCursor = 0;
+	job.meshCursor = 0;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		queued.push_back(job);
+	}
+	jobQueued.notify_one();
+}
+
+void AssetLoader::WorkerLoop()
+{
+	while (true)
+	{
+		Job job;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			jobQueued.wait(lock, [this] { return stopping || !queued.empty(); });
+			if (stopping)
+				return;
+
+			job = queued.front();
+			queued.pop_front();
+			importing++;
+		}
+
+		job.data = new ModelData;
+		Model::Import(job.path, *job.data);
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			imported.push_back(job);
+			importing--;
+		}
+		jobImported.notify_all();
+	}
+}
+
+bool AssetLoader::UploadStep(Job& job)
+{
+	ModelData& data = *job.data;
+
+	if (job.textureCursor < (int)data.textures.size())
+		Model::UploadTexture(data, job.textureCursor++);
+	else if (job.meshCursor < (int)data.meshes.size())
+		Model::UploadMesh(data, job.meshCursor++);
+
+	return job.textureCursor == (int)data.textures.size() && job.meshCursor == (int)data.meshes.size();
+}
+
+void AssetLoader::Update(float budgetMs)
+{
+	PROFILE_ZONE("AssetLoader::Update");
+
+	auto start = std::chrono::steady_clock::now();
+
+	do
+	{
+		if (!hasUploading)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (imported.empty())
+				return;
+
+			uploading = imported.front();
+			imported.pop_front();
+			hasUploading = true;
+		}
+
+		if (UploadStep(uploading))
+		{
+			uploading.model->Adopt(*uploading.data);
+			delete uploading.data;
+			uploading.model.reset();
+			hasUploading = false;
+		}
+	} while (std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count() < budgetMs);
+}
+
+void AssetLoader::Finish()
+{
+	while (true)
+	{
+		Update(FLT_MAX);
+
+		std::unique_lock<std::mutex> lock(mutex);
+		if (queued.empty() && importing == 0 && imported.empty())
+			return;
+
+		jobImported.wait(lock, [this] { return !imported.empty() || (queued.empty() && importing == 0); });
+	}
+}
+
+int AssetLoader::GetPendingCount() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return (int)(queued.size() + imported.size()) + importing + (hasUploading ? 1 : 0);
+}
+
+void AssetLoader::Shutdown()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	jobQueued.notify_all();
+
+	for (unsigned int i = 0; i < workers.size(); i++)
+		workers[i].join();
+	workers.clear();
+}
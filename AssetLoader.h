@@ -0,0 +1,76 @@
+#pragma once
+#ifndef ASSETLOADER_H
+#define ASSETLOADER_H
+
+#include <string>
+#include <memory>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "Model.h"
+
+// loads models in the background, Assimp import, image decoding and the mesh BVHs run on a pool of worker threads
+// the GL side (textures, vertex buffers) has to happen on the render thread, Update does it in steps of one texture or mesh
+// until the frame's time budget is used up, so a level streams in without hitches
+//
+// a model handed to LoadModelAsync is a placeholder that stays empty until Model::IsReady, callers check that before using it
+class AssetLoader
+{
+public:
+	static AssetLoader* GetInstance();
+
+	// queues the import of path into model, the loader keeps a reference until the upload is done
+	// use ResourceCache::GetModel to load a file, it makes sure every file is only imported once
+	void LoadModelAsync(const std::shared_ptr<Model>& model, const std::string& path);
+
+	// uploads finished imports on the calling (GL) thread until budgetMs is spent, at least one step is always done
+	void Update(float budgetMs);
+
+	// blocks until everything queued so far is imported and uploaded
+	void Finish();
+
+	// queued, importing or waiting for upload
+	int GetPendingCount() const;
+
+	// lets the workers finish their current import and joins them
+	void Shutdown();
+private:
+	AssetLoader();
+
+	struct Job
+	{
+		std::shared_ptr<Model> model;
+		std::string path;
+		ModelData* data;
+		// upload progress, textures first and then meshes
+		int textureCursor;
+		int meshCursor;
+	};
+
+	std::vector<std::thread> workers;
+
+	// guarded by mutex
+	std::deque<Job> queued;
+	std::deque<Job> imported;
+	int importing;
+	bool stopping;
+
+	mutable std::mutex mutex;
+	std::condition_variable jobQueued;
+	std::condition_variable jobImported;
+
+	// only touched by the GL thread
+	Job uploading;
+	bool hasUploading;
+
+	void StartWorkers();
+	void WorkerLoop();
+	// one texture or mesh of the job, true once everything is uploaded
+	bool UploadStep(Job& job);
+
+	static AssetLoader* loaderInstance;
+};
+
+#endif
@@ -0,0 +1,352 @@
+#pragma once
+#ifndef BVHTREE_H
+#define BVHTREE_H
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <algorithm>
+#include <float.h>
+#include "RayKernels.h"
+
+// binned SAH build, bottom up refit and nearest first ray traversal, shared by SceneBVH (model instance spheres) and
+// MeshBVH (triangles of one mesh). The tree only stores primitive indices, the owner supplies their bounds and the leaf test:
+//
+//	struct Bounds
+//	{
+//		void GetBounds(int prim, glm::vec3& bMin, glm::vec3& bMax) const;
+//		glm::vec3 GetCentroid(int prim) const;
+//	};
+//
+//	// tests the primitives in leaf slots [first, first + count) and lowers bestT on a closer hit
+//	void leaf(int first, int count, float& bestT);
+template <int SahBins>
+class BVHTree
+{
+public:
+	struct Node
+	{
+		glm::vec3 boundsMin;
+		glm::vec3 boundsMax;
+		// for leaves the first leaf slot, for inner nodes the index of the left child (right child follows it)
+		int leftFirst;
+		// number of primitives, 0 for inner nodes
+		int count;
+	};
+
+	// children are always stored after their parent
+	std::vector<Node> nodes;
+	// primitive of every leaf slot, a leaf covers a contiguous range of slots
+	std::vector<int> primIndices;
+	// deepest level reached by the build (the root is 0), Traverse sizes its stack from it
+	int maxDepth;
+
+	BVHTree() : maxDepth(0) { }
+
+	bool IsBuilt() const
+	{
+		return !nodes.empty();
+	}
+
+	void Clear()
+	{
+		nodes.clear();
+		primIndices.clear();
+		maxDepth = 0;
+	}
+
+	// nodes with more than maxLeafSize primitives are split unless the SAH finds the leaf cheaper than any split,
+	// which it is only allowed to above forceSplitAbove primitives
+	template <typename Bounds>
+	void Build(int primCount, const Bounds& bounds, int maxLeafSize, int forceSplitAbove)
+	{
+		Clear();
+		if (primCount == 0)
+			return;
+
+		primIndices.resize(primCount);
+		for (int i = 0; i < primCount; i++)
+			primIndices[i] = i;
+
+		// a binary tree with N leaves has at most 2N - 1 nodes
+		nodes.reserve(primCount * 2);
+
+		Node root;
+		root.leftFirst = 0;
+		root.count = primCount;
+		nodes.push_back(root);
+
+		UpdateNodeBounds(0, bounds);
+		Subdivide(0, 0, bounds, maxLeafSize, forceSplitAbove);
+	}
+
+	// same primitives, new bounds, the structure is kept
+	template <typename Bounds>
+	void Refit(const Bounds& bounds)
+	{
+		// walking backwards visits the children before their parent
+		for (int i = (int)nodes.size() - 1; i >= 0; i--)
+		{
+			Node& node = nodes[i];
+			if (node.count > 0)
+			{
+				UpdateNodeBounds(i, bounds);
+			}
+			else
+			{
+				const Node& left = nodes[node.leftFirst];
+				const Node& right = nodes[node.leftFirst + 1];
+				node.boundsMin = glm::min(left.boundsMin, right.boundsMin);
+				node.boundsMax = glm::max(left.boundsMax, right.boundsMax);
+			}
+		}
+	}
+
+	// visits the leaves the ray reaches before bestT, nearer child first so that a close hit shrinks bestT early and prunes the far side
+	template <typename Leaf>
+	void Traverse(const glm::vec3& orig, const glm::vec3& dir, float& bestT, const Leaf& leaf) const
+	{
+		if (nodes.empty())
+			return;
+
+		glm::vec3 invDir(1.0f / dir.x, 1.0f / dir.y, 1.0f / dir.z);
+
+		// popping a node at depth d leaves at most d far siblings and pushes two children, so maxDepth + 1 entries always fit
+		// a degenerate tree deeper than the local buffer gets a heap stack rather than dropping subtrees
+		int stackBuffer[LocalStackSize];
+		float stackTBuffer[LocalStackSize];
+		std::vector<int> stackHeap;
+		std::vector<float> stackTHeap;
+		int* stack = stackBuffer;
+		float* stackT = stackTBuffer;
+		if (maxDepth + 1 > LocalStackSize)
+		{
+			stackHeap.resize(maxDepth + 1);
+			stackTHeap.resize(maxDepth + 1);
+			stack = stackHeap.data();
+			stackT = stackTHeap.data();
+		}
+		int stackSize = 0;
+
+		float tRoot = IntersectAABB(orig, invDir, nodes[0].boundsMin, nodes[0].boundsMax, bestT);
+		if (tRoot == FLT_MAX)
+			return;
+		stack[stackSize] = 0;
+		stackT[stackSize++] = tRoot;
+
+		while (stackSize > 0)
+		{
+			stackSize--;
+			// a closer hit was found after this node was pushed
+			if (stackT[stackSize] >= bestT)
+				continue;
+
+			const Node& node = nodes[stack[stackSize]];
+
+			if (node.count > 0)
+			{
+				leaf(node.leftFirst, node.count, bestT);
+				continue;
+			}
+
+			// both children in one RayBoxes call, repeated to fill the 4 lanes of an SSE register
+			int leftIdx = node.leftFirst;
+			int rightIdx = node.leftFirst + 1;
+			float minX[4], minY[4], minZ[4], maxX[4], maxY[4], maxZ[4], tChild[4];
+			for (int c = 0; c < 4; c++)
+			{
+				const Node& child = nodes[leftIdx + (c & 1)];
+				minX[c] = child.boundsMin.x; minY[c] = child.boundsMin.y; minZ[c] = child.boundsMin.z;
+				maxX[c] = child.boundsMax.x; maxY[c] = child.boundsMax.y; maxZ[c] = child.boundsMax.z;
+			}
+			RayKernels::RayBoxes(orig, invDir, minX, minY, minZ, maxX, maxY, maxZ, 4, bestT, tChild);
+			float tLeft = tChild[0];
+			float tRight = tChild[1];
+
+			if (tLeft > tRight)
+			{
+				std::swap(tLeft, tRight);
+				std::swap(leftIdx, rightIdx);
+			}
+
+			if (tRight != FLT_MAX)
+			{
+				stack[stackSize] = rightIdx;
+				stackT[stackSize++] = tRight;
+			}
+			if (tLeft != FLT_MAX)
+			{
+				stack[stackSize] = leftIdx;
+				stackT[stackSize++] = tLeft;
+			}
+		}
+	}
+
+private:
+	// traversal stack kept on the stack frame, trees deeper than this get a heap stack instead
+	static const int LocalStackSize = 64;
+
+	template <typename Bounds>
+	void UpdateNodeBounds(int nodeIdx, const Bounds& bounds)
+	{
+		Node& node = nodes[nodeIdx];
+		node.boundsMin = glm::vec3(FLT_MAX);
+		node.boundsMax = glm::vec3(-FLT_MAX);
+
+		for (int i = 0; i < node.count; i++)
+		{
+			glm::vec3 bMin, bMax;
+			bounds.GetBounds(primIndices[node.leftFirst + i], bMin, bMax);
+			node.boundsMin = glm::min(node.boundsMin, bMin);
+			node.boundsMax = glm::max(node.boundsMax, bMax);
+		}
+	}
+
+	// binned SAH, the centroid extent of every axis is split into SahBins buckets and the cheapest bucket boundary wins
+	template <typename Bounds>
+	float FindBestSplit(const Node& node, const Bounds& bounds, int& axis, float& splitPos) const
+	{
+		float bestCost = FLT_MAX;
+
+		for (int a = 0; a < 3; a++)
+		{
+			float cMin = FLT_MAX;
+			float cMax = -FLT_MAX;
+			for (int i = 0; i < node.count; i++)
+			{
+				float c = bounds.GetCentroid(primIndices[node.leftFirst + i])[a];
+				cMin = glm::min(cMin, c);
+				cMax = glm::max(cMax, c);
+			}
+			if (cMin == cMax)
+				continue;
+
+			glm::vec3 binMin[SahBins];
+			glm::vec3 binMax[SahBins];
+			int binCount[SahBins];
+			for (int b = 0; b < SahBins; b++)
+			{
+				binMin[b] = glm::vec3(FLT_MAX);
+				binMax[b] = glm::vec3(-FLT_MAX);
+				binCount[b] = 0;
+			}
+
+			float scale = SahBins / (cMax - cMin);
+			for (int i = 0; i < node.count; i++)
+			{
+				int prim = primIndices[node.leftFirst + i];
+				int b = glm::min(SahBins - 1, (int)((bounds.GetCentroid(prim)[a] - cMin) * scale));
+				glm::vec3 bMin, bMax;
+				bounds.GetBounds(prim, bMin, bMax);
+				binMin[b] = glm::min(binMin[b], bMin);
+				binMax[b] = glm::max(binMax[b], bMax);
+				binCount[b]++;
+			}
+
+			// sweep from both sides to get the area and count left and right of every bin boundary
+			float leftArea[SahBins - 1], rightArea[SahBins - 1];
+			int leftCount[SahBins - 1], rightCount[SahBins - 1];
+			glm::vec3 lMin(FLT_MAX), lMax(-FLT_MAX), rMin(FLT_MAX), rMax(-FLT_MAX);
+			int lSum = 0, rSum = 0;
+			for (int b = 0; b < SahBins - 1; b++)
+			{
+				lSum += binCount[b];
+				leftCount[b] = lSum;
+				lMin = glm::min(lMin, binMin[b]);
+				lMax = glm::max(lMax, binMax[b]);
+				leftArea[b] = lSum > 0 ? SurfaceArea(lMin, lMax) : 0.0f;
+
+				rSum += binCount[SahBins - 1 - b];
+				rightCount[SahBins - 2 - b] = rSum;
+				rMin = glm::min(rMin, binMin[SahBins - 1 - b]);
+				rMax = glm::max(rMax, binMax[SahBins - 1 - b]);
+				rightArea[SahBins - 2 - b] = rSum > 0 ? SurfaceArea(rMin, rMax) : 0.0f;
+			}
+
+			for (int b = 0; b < SahBins - 1; b++)
+			{
+				float cost = leftCount[b] * leftArea[b] + rightCount[b] * rightArea[b];
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					axis = a;
+					splitPos = cMin + (b + 1) / scale;
+				}
+			}
+		}
+
+		return bestCost;
+	}
+
+	template <typename Bounds>
+	void Subdivide(int nodeIdx, int depth, const Bounds& bounds, int maxLeafSize, int forceSplitAbove)
+	{
+		if (nodes[nodeIdx].count <= maxLeafSize)
+			return;
+
+		int axis = 0;
+		float splitPos = 0.0f;
+		float splitCost = FindBestSplit(nodes[nodeIdx], bounds, axis, splitPos);
+
+		Node& node = nodes[nodeIdx];
+		float leafCost = node.count * SurfaceArea(node.boundsMin, node.boundsMax);
+		if (splitCost >= leafCost && node.count <= forceSplitAbove)
+			return;
+
+		// partition the leaf slots around the split plane
+		int i = node.leftFirst;
+		int j = i + node.count - 1;
+		while (i <= j)
+		{
+			if (bounds.GetCentroid(primIndices[i])[axis] < splitPos)
+				i++;
+			else
+				std::swap(primIndices[i], primIndices[j--]);
+		}
+
+		int leftCount = i - node.leftFirst;
+		if (leftCount == 0 || leftCount == node.count)
+			return;
+
+		Node left, right;
+		left.leftFirst = node.leftFirst;
+		left.count = leftCount;
+		right.leftFirst = i;
+		right.count = node.count - leftCount;
+
+		int leftIdx = (int)nodes.size();
+		nodes.push_back(left);
+		nodes.push_back(right);
+
+		// node may dangle after push_back, index again
+		nodes[nodeIdx].leftFirst = leftIdx;
+		nodes[nodeIdx].count = 0;
+
+		UpdateNodeBounds(leftIdx, bounds);
+		UpdateNodeBounds(leftIdx + 1, bounds);
+		maxDepth = std::max(maxDepth, depth + 1);
+		Subdivide(leftIdx, depth + 1, bounds, maxLeafSize, forceSplitAbove);
+		Subdivide(leftIdx + 1, depth + 1, bounds, maxLeafSize, forceSplitAbove);
+	}
+
+	// slab test, returns the entry distance or FLT_MAX on a miss (or if the box is further than tMax)
+	static float IntersectAABB(const glm::vec3& orig, const glm::vec3& invDir, const glm::vec3& bMin, const glm::vec3& bMax, float tMax)
+	{
+		glm::vec3 t1 = (bMin - orig) * invDir;
+		glm::vec3 t2 = (bMax - orig) * invDir;
+
+		float tNear = glm::max(glm::max(glm::min(t1.x, t2.x), glm::min(t1.y, t2.y)), glm::min(t1.z, t2.z));
+		float tFar = glm::min(glm::min(glm::max(t1.x, t2.x), glm::max(t1.y, t2.y)), glm::max(t1.z, t2.z));
+
+		if (tFar >= tNear && tFar > 0.0f && tNear < tMax)
+			return tNear;
+		return FLT_MAX;
+	}
+
+	static float SurfaceArea(const glm::vec3& bMin, const glm::vec3& bMax)
+	{
+		glm::vec3 e = bMax - bMin;
+		return e.x * e.y + e.y * e.z + e.z * e.x;
+	}
+};
+
+#endif
@@ -0,0 +1,316 @@
+#include "BakedMesh.h"
+#include "MappedFile.h"
+#include "Headless.h"
+#include "MeshOptimizer.h"
+#include <stdio.h>
+#include <string.h>
+#include <float.h>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+static const char BakedMagic[4] = { 'F', 'P', 'S', 'M' };
+static const size_t BlobAlignment = 16;
+
+static size_t AlignUp(size_t offset)
+{
+	return (offset + BlobAlignment - 1) & ~(BlobAlignment - 1);
+}
+
+std::string BakedMesh::GetBakedPath(const std::string& sourcePath)
+{
+	return sourcePath + ".bmesh";
+}
+
+bool BakedMesh::IsUpToDate(const std::string& sourcePath, const std::string& bakedPath)
+{
+	std::error_code error;
+	fs::file_time_type bakedTime = fs::last_write_time(bakedPath, error);
+	if (error)
+		return false;
+
+	// a build may ship only the baked files
+	fs::file_time_type sourceTime = fs::last_write_time(sourcePath, error);
+	if (error)
+		return true;
+
+	return bakedTime >= sourceTime;
+}
+
+bool BakedMesh::Bake(const std::string& sourcePath)
+{
+	ModelData data;
+	if (!Model::ImportSource(sourcePath, data))
+		return false;
+
+	return Write(GetBakedPath(sourcePath), data);
+}
+
+int BakedMesh::BakeAll(const std::vector<std::string>& sourcePaths)
+{
+	// only the CPU side is needed, textures are referenced by path and not decoded
+	Headless::Enable();
+	MeshOptimizer::SetReportStats(true);
+
+	std::vector<std::string> paths = sourcePaths;
+	if (paths.empty())
+	{
+		std::error_code error;
+		for (fs::recursive_directory_iterator it("./models", error), end; it != end; it.increment(error))
+		{
+			std::string extension = it->path().extension().string();
+			if (extension == ".obj" || extension == ".fbx" || extension == ".dae" || extension == ".3ds")
+				paths.push_back(it->path().generic_string());
+		}
+	}
+
+	int failed = 0;
+	for (unsigned int i = 0; i < paths.size(); i++)
+	{
+		if (Bake(paths[i]))
+		{
+			printf("Baked %s\n", GetBakedPath(paths[i]).c_str());
+		}
+		else
+		{
+			printf("Unable to bake %s\n", paths[i].c_str());
+			failed++;
+		}
+	}
+	return failed;
+}
+
+bool BakedMesh::Write(const std::string& bakedPath, const ModelData& data)
+{
+	Header header;
+	memcpy(header.magic, BakedMagic, sizeof(header.magic));
+	header.version = Version;
+	header.vertexSize = sizeof(Vertex);
+	header.meshCount = (uint32_t)data.meshes.size();
+	header.textureCount = (uint32_t)data.textures.size();
+	header.meshTextureCount = 0;
+
+	std::vector<TextureRef> textureRefs(data.textures.size());
+	for (unsigned int t = 0; t < data.textures.size(); t++)
+	{
+		const Texture& texture = data.textures[t];
+		if (texture.type.size() >= sizeof(textureRefs[t].type) || texture.path.size() >= sizeof(textureRefs[t].path))
+		{
+			printf("BakedMesh: texture name too long in %s: %s\n", bakedPath.c_str(), texture.path.c_str());
+			return false;
+		}
+		memset(&textureRefs[t], 0, sizeof(TextureRef));
+		memcpy(textureRefs[t].type, texture.type.c_str(), texture.type.size());
+		memcpy(textureRefs[t].path, texture.path.c_str(), texture.path.size());
+	}
+
+	// the meshes hold copies of the model textures, point them back at the table by path (which is how Import deduplicated them)
+	std::vector<uint32_t> meshTextures;
+	std::vector<MeshEntry> entries(data.meshes.size());
+	for (unsigned int m = 0; m < data.meshes.size(); m++)
+	{
+		const Mesh& mesh = data.meshes[m];
+		MeshEntry& entry = entries[m];
+		entry.vertexCount = (uint32_t)mesh.vertices.size();
+		entry.indexCount = (uint32_t)mesh.indices.size();
+		entry.firstTexture = (uint32_t)meshTextures.size();
+		entry.textureCount = (uint32_t)mesh.textures.size();
+		entry.lodIndexCount = (uint32_t)mesh.lodIndices.size();
+		entry.lodCount = (uint32_t)mesh.lods.size();
+		for (int l = 0; l < Mesh::MaxLods - 1; l++)
+		{
+			entry.lodFirstIndex[l] = l < (int)mesh.lods.size() ? mesh.lods[l].firstIndex : 0;
+			entry.lodIndexCounts[l] = l < (int)mesh.lods.size() ? mesh.lods[l].indexCount : 0;
+		}
+
+		for (unsigned int t = 0; t < mesh.textures.size(); t++)
+		{
+			uint32_t index = 0;
+			for (unsigned int k = 0; k < data.textures.size(); k++)
+			{
+				if (data.textures[k].path == mesh.textures[t].path)
+				{
+					index = k;
+					break;
+				}
+			}
+			meshTextures.push_back(index);
+		}
+
+		glm::vec3 bMin(FLT_MAX), bMax(-FLT_MAX);
+		for (unsigned int v = 0; v < mesh.vertices.size(); v++)
+		{
+			bMin = glm::min(bMin, mesh.vertices[v].Position);
+			bMax = glm::max(bMax, mesh.vertices[v].Position);
+		}
+		for (int c = 0; c < 3; c++)
+		{
+			entry.boundsMin[c] = bMin[c];
+			entry.boundsMax[c] = bMax[c];
+		}
+	}
+	header.meshTextureCount = (uint32_t)meshTextures.size();
+
+	// lay out the blobs after the tables
+	size_t offset = sizeof(Header) + entries.size() * sizeof(MeshEntry) + textureRefs.size() * sizeof(TextureRef) + meshTextures.size() * sizeof(uint32_t);
+	for (unsigned int m = 0; m < entries.size(); m++)
+	{
+		offset = AlignUp(offset);
+		entries[m].vertexOffset = offset;
+		offset += entries[m].vertexCount * sizeof(Vertex);
+
+		offset = AlignUp(offset);
+		entries[m].indexOffset = offset;
+		offset += entries[m].indexCount * sizeof(uint32_t);
+
+		offset = AlignUp(offset);
+		entries[m].lodIndexOffset = offset;
+		offset += entries[m].lodIndexCount * sizeof(uint32_t);
+	}
+
+	FILE* file = fopen(bakedPath.c_str(), "wb");
+	if (file == NULL)
+		return false;
+
+	fwrite(&header, sizeof(Header), 1, file);
+	if (!entries.empty())
+		fwrite(entries.data(), sizeof(MeshEntry), entries.size(), file);
+	if (!textureRefs.empty())
+		fwrite(textureRefs.data(), sizeof(TextureRef), textureRefs.size(), file);
+	if (!meshTextures.empty())
+		fwrite(meshTextures.data(), sizeof(uint32_t), meshTextures.size(), file);
+
+	static const unsigned char padding[BlobAlignment] = { 0 };
+	for (unsigned int m = 0; m < entries.size(); m++)
+	{
+		const Mesh& mesh = data.meshes[m];
+
+		long position = ftell(file);
+		fwrite(padding, 1, entries[m].vertexOffset - position, file);
+		if (!mesh.vertices.empty())
+			fwrite(mesh.vertices.data(), sizeof(Vertex), mesh.vertices.size(), file);
+
+		position = ftell(file);
+		fwrite(padding, 1, entries[m].indexOffset - position, file);
+		if (!mesh.indices.empty())
+			fwrite(mesh.indices.data(), sizeof(uint32_t), mesh.indices.size(), file);
+
+		position = ftell(file);
+		fwrite(padding, 1, entries[m].lodIndexOffset - position, file);
+		if (!mesh.lodIndices.empty())
+			fwrite(mesh.lodIndices.data(), sizeof(uint32_t), mesh.lodIndices.size(), file);
+	}
+
+	bool ok = ferror(file) == 0;
+	fclose(file);
+	return ok;
+}
+
+bool BakedMesh::Read(const std::string& sourcePath, ModelData& data)
+{
+	std::string bakedPath = GetBakedPath(sourcePath);
+	if (!IsUpToDate(sourcePath, bakedPath))
+		return false;
+
+	MappedFile file;
+	if (!file.Open(bakedPath))
+		return false;
+
+	const unsigned char* base = file.GetData();
+	size_t size = file.GetSize();
+
+	if (size < sizeof(Header))
+		return false;
+	const Header& header = *(const Header*)base;
+	if (memcmp(header.magic, BakedMagic, sizeof(header.magic)) != 0 || header.version != Version || header.vertexSize != sizeof(Vertex))
+	{
+		printf("BakedMesh: %s is from another version, rebake it\n", bakedPath.c_str());
+		return false;
+	}
+
+	size_t tablesSize = sizeof(Header) + (size_t)header.meshCount * sizeof(MeshEntry) + (size_t)header.textureCount * sizeof(TextureRef) + (size_t)header.meshTextureCount * sizeof(uint32_t);
+	if (size < tablesSize)
+		return false;
+
+	const MeshEntry* entries = (const MeshEntry*)(base + sizeof(Header));
+	const TextureRef* textureRefs = (const TextureRef*)(entries + header.meshCount);
+	const uint32_t* meshTextures = (const uint32_t*)(textureRefs + header.textureCount);
+
+	// validate everything before touching data, a truncated file falls back to the source
+	for (uint32_t m = 0; m < header.meshCount; m++)
+	{
+		const MeshEntry& entry = entries[m];
+		if (entry.vertexOffset + (uint64_t)entry.vertexCount * sizeof(Vertex) > size || entry.indexOffset + (uint64_t)entry.indexCount * sizeof(uint32_t) > size)
+			return false;
+		if ((uint64_t)entry.firstTexture + entry.textureCount > header.meshTextureCount)
+			return false;
+		if (entry.lodIndexOffset + (uint64_t)entry.lodIndexCount * sizeof(uint32_t) > size || entry.lodCount >= (uint32_t)Mesh::MaxLods)
+			return false;
+		for (uint32_t l = 0; l < entry.lodCount; l++)
+		{
+			if ((uint64_t)entry.lodFirstIndex[l] + entry.lodIndexCounts[l] > entry.lodIndexCount)
+				return false;
+		}
+		for (uint32_t t = 0; t < entry.textureCount; t++)
+		{
+			if (meshTextures[entry.firstTexture + t] >= header.textureCount)
+				return false;
+		}
+
+		// a stale or corrupt file can have the right sizes and still point past the vertices, the BVH build and the upload would read out of bounds
+		const uint32_t* indices = (const uint32_t*)(base + entry.indexOffset);
+		for (uint32_t i = 0; i < entry.indexCount; i++)
+		{
+			if (indices[i] >= entry.vertexCount)
+			{
+				printf("BakedMesh: %s has an index out of range, falling back to the source\n", bakedPath.c_str());
+				return false;
+			}
+		}
+		const uint32_t* lodIndices = (const uint32_t*)(base + entry.lodIndexOffset);
+		for (uint32_t i = 0; i < entry.lodIndexCount; i++)
+		{
+			if (lodIndices[i] >= entry.vertexCount)
+			{
+				printf("BakedMesh: %s has an index out of range, falling back to the source\n", bakedPath.c_str());
+				return false;
+			}
+		}
+	}
+
+	// the texture table is already free of duplicates, it resolves straight to the shared textures
+	std::vector<Texture> textures(header.textureCount);
+	for (uint32_t t = 0; t < header.textureCount; t++)
+	{
+		std::string type(textureRefs[t].type, strnlen(textureRefs[t].type, sizeof(textureRefs[t].type)));
+		std::string path(textureRefs[t].path, strnlen(textureRefs[t].path, sizeof(textureRefs[t].path)));
+		textures[t] = Model::AddMaterialTexture(path, type, data);
+	}
+
+	data.meshes.reserve(header.meshCount);
+	for (uint32_t m = 0; m < header.meshCount; m++)
+	{
+		const MeshEntry& entry = entries[m];
+		const Vertex* vertices = (const Vertex*)(base + entry.vertexOffset);
+		const uint32_t* indices = (const uint32_t*)(base + entry.indexOffset);
+
+		std::vector<Texture> meshTextureList(entry.textureCount);
+		for (uint32_t t = 0; t < entry.textureCount; t++)
+			meshTextureList[t] = textures[meshTextures[entry.firstTexture + t]];
+
+		// one copy of the mapped blobs, moved into the mesh, the GL buffers are filled from them by Model::UploadMesh
+		data.meshes.push_back(Mesh(std::vector<Vertex>(vertices, vertices + entry.vertexCount),
+			std::vector<unsigned int>(indices, indices + entry.indexCount), std::move(meshTextureList), false));
+
+		const uint32_t* lodIndices = (const uint32_t*)(base + entry.lodIndexOffset);
+		Mesh& mesh = data.meshes.back();
+		mesh.lodIndices.assign(lodIndices, lodIndices + entry.lodIndexCount);
+		for (uint32_t l = 0; l < entry.lodCount; l++)
+		{
+			Mesh::Lod lod = { entry.lodFirstIndex[l], entry.lodIndexCounts[l] };
+			mesh.lods.push_back(lod);
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,77 @@
+#pragma once
+#ifndef BAKEDMESH_H
+#define BAKEDMESH_H
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "Model.h"
+
+// binary mesh format written by the offline baker (FPS_Game --bake) next to the source file as <source>.bmesh
+// the vertex and index data are stored exactly as the Mesh keeps them, so loading needs no Assimp import or post processing:
+// the file is memory mapped, every index is range checked, the blobs are copied once into the meshes and the MeshBVH is rebuilt from them
+//
+//	Header
+//	MeshEntry[meshCount]
+//	TextureRef[textureCount]			distinct material textures of the model, paths relative to the model directory
+//	uint32_t meshTextures[...]			per mesh indices into the TextureRef table (MeshEntry::firstTexture, textureCount)
+//	vertex, index and lod index blobs	Vertex / uint32_t arrays, 16 byte aligned
+//
+// Model::Import picks the baked file when it exists and is not older than the source, otherwise it falls back to Assimp
+class BakedMesh
+{
+public:
+	// bumped whenever the layout (or the Vertex struct, or the import processing) changes, older files are ignored
+	static const uint32_t Version = 3;
+
+	static std::string GetBakedPath(const std::string& sourcePath);
+
+	// imports the source with Assimp and writes the baked file
+	static bool Bake(const std::string& sourcePath);
+	// bakes the given files, or every model below ./models if there are none, returns the number of failures
+	static int BakeAll(const std::vector<std::string>& sourcePaths);
+
+	// fills data from the baked file of sourcePath, false if there is no usable one
+	static bool Read(const std::string& sourcePath, ModelData& data);
+
+	// baked file exists and is not older than its source (also used for the baked textures)
+	static bool IsUpToDate(const std::string& sourcePath, const std::string& bakedPath);
+private:
+	struct Header
+	{
+		char magic[4];
+		uint32_t version;
+		uint32_t vertexSize;
+		uint32_t meshCount;
+		uint32_t textureCount;
+		uint32_t meshTextureCount;
+	};
+
+	struct MeshEntry
+	{
+		uint64_t vertexOffset;
+		uint64_t indexOffset;
+		uint32_t vertexCount;
+		uint32_t indexCount;
+		uint32_t firstTexture;
+		uint32_t textureCount;
+		float boundsMin[3];
+		float boundsMax[3];
+		// simplified levels (Mesh::lods), their indices are one blob in Mesh::lodIndices order
+		uint64_t lodIndexOffset;
+		uint32_t lodIndexCount;
+		uint32_t lodCount;
+		uint32_t lodFirstIndex[Mesh::MaxLods - 1];
+		uint32_t lodIndexCounts[Mesh::MaxLods - 1];
+	};
+
+	struct TextureRef
+	{
+		char type[32];
+		char path[224];
+	};
+
+	static bool Write(const std::string& bakedPath, const ModelData& data);
+};
+
+#endif
@@ -0,0 +1,396 @@
+#include "BakedTexture.h"
+#include "BakedMesh.h"
+#include "MappedFile.h"
+#include "Model.h"
+#include "Headless.h"
+#include "stb_image.h"
+#include <stdio.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+static const uint8_t KtxIdentifier[12] = { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x31, 0x31, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A };
+static const uint32_t KtxEndianness = 0x04030201;
+
+// decoded 565 endpoint, the low bits are filled by replication like the hardware does
+static void UnpackColor(uint16_t c, float rgb[3])
+{
+	int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+	rgb[0] = (float)((r << 3) | (r >> 2));
+	rgb[1] = (float)((g << 2) | (g >> 4));
+	rgb[2] = (float)((b << 3) | (b >> 2));
+}
+
+static uint16_t PackColor(const float rgb[3])
+{
+	int r = (int)(glm::clamp(rgb[0], 0.0f, 255.0f) * 31.0f / 255.0f + 0.5f);
+	int g = (int)(glm::clamp(rgb[1], 0.0f, 255.0f) * 63.0f / 255.0f + 0.5f);
+	int b = (int)(glm::clamp(rgb[2], 0.0f, 255.0f) * 31.0f / 255.0f + 0.5f);
+	return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+// BC1 color block of 16 RGBA pixels, always in 4 color mode (which is the only mode BC3 knows)
+// the endpoints are the extremes of the pixels projected on the principal axis of their colors
+static void CompressColorBlock(const unsigned char* block, unsigned char* out)
+{
+	float mean[3] = { 0.0f, 0.0f, 0.0f };
+	for (int i = 0; i < 16; i++)
+		for (int c = 0; c < 3; c++)
+			mean[c] += block[i * 4 + c];
+	for (int c = 0; c < 3; c++)
+		mean[c] /= 16.0f;
+
+	float cov[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+	for (int i = 0; i < 16; i++)
+	{
+		float r = block[i * 4] - mean[0], g = block[i * 4 + 1] - mean[1], b = block[i * 4 + 2] - mean[2];
+		cov[0] += r * r; cov[1] += r * g; cov[2] += r * b;
+		cov[3] += g * g; cov[4] += g * b; cov[5] += b * b;
+	}
+
+	// a few power iterations are plenty for a 3x3 matrix
+	float axis[3] = { 1.0f, 1.0f, 1.0f };
+	for (int iteration = 0; iteration < 8; iteration++)
+	{
+		float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+		float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+		float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+		float length = fmaxf(fabsf(x), fmaxf(fabsf(y), fabsf(z)));
+		if (length < 1e-6f)
+			break;
+		axis[0] = x / length; axis[1] = y / length; axis[2] = z / length;
+	}
+
+	float minDot = FLT_MAX, maxDot = -FLT_MAX;
+	int minPixel = 0, maxPixel = 0;
+	for (int i = 0; i < 16; i++)
+	{
+		float d = block[i * 4] * axis[0] + block[i * 4 + 1] * axis[1] + block[i * 4 + 2] * axis[2];
+		if (d < minDot) { minDot = d; minPixel = i; }
+		if (d > maxDot) { maxDot = d; maxPixel = i; }
+	}
+
+	float maxColor[3] = { (float)block[maxPixel * 4], (float)block[maxPixel * 4 + 1], (float)block[maxPixel * 4 + 2] };
+	float minColor[3] = { (float)block[minPixel * 4], (float)block[minPixel * 4 + 1], (float)block[minPixel * 4 + 2] };
+	uint16_t c0 = PackColor(maxColor);
+	uint16_t c1 = PackColor(minColor);
+	if (c0 < c1)
+	{
+		uint16_t t = c0; c0 = c1; c1 = t;
+	}
+
+	uint32_t indices = 0;
+	if (c0 != c1)
+	{
+		float palette[4][3];
+		UnpackColor(c0, palette[0]);
+		UnpackColor(c1, palette[1]);
+		for (int c = 0; c < 3; c++)
+		{
+			palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+			palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+		}
+
+		for (int i = 0; i < 16; i++)
+		{
+			int best = 0;
+			float bestError = FLT_MAX;
+			for (int p = 0; p < 4; p++)
+			{
+				float r = block[i * 4] - palette[p][0], g = block[i * 4 + 1] - palette[p][1], b = block[i * 4 + 2] - palette[p][2];
+				float error = r * r + g * g + b * b;
+				if (error < bestError)
+				{
+					bestError = error;
+					best = p;
+				}
+			}
+			indices |= (uint32_t)best << (i * 2);
+		}
+	}
+
+	out[0] = (unsigned char)(c0 & 0xFF); out[1] = (unsigned char)(c0 >> 8);
+	out[2] = (unsigned char)(c1 & 0xFF); out[3] = (unsigned char)(c1 >> 8);
+	for (int b = 0; b < 4; b++)
+		out[4 + b] = (unsigned char)(indices >> (b * 8));
+}
+
+// BC3 alpha block, 8 interpolated values between the block's min and max alpha
+static void CompressAlphaBlock(const unsigned char* block, unsigned char* out)
+{
+	int a0 = 0, a1 = 255;
+	for (int i = 0; i < 16; i++)
+	{
+		int a = block[i * 4 + 3];
+		if (a > a0) a0 = a;
+		if (a < a1) a1 = a;
+	}
+
+	uint64_t indices = 0;
+	if (a0 != a1)
+	{
+		int palette[8] = { a0, a1 };
+		for (int p = 1; p < 7; p++)
+			palette[p + 1] = ((7 - p) * a0 + p * a1) / 7;
+
+		for (int i = 0; i < 16; i++)
+		{
+			int a = block[i * 4 + 3];
+			int best = 0, bestError = 256;
+			for (int p = 0; p < 8; p++)
+			{
+				int error = abs(a - palette[p]);
+				if (error < bestError)
+				{
+					bestError = error;
+					best = p;
+				}
+			}
+			indices |= (uint64_t)best << (i * 3);
+		}
+	}
+
+	out[0] = (unsigned char)a0;
+	out[1] = (unsigned char)a1;
+	for (int b = 0; b < 6; b++)
+		out[2 + b] = (unsigned char)(indices >> (b * 8));
+}
+
+std::string BakedTexture::GetBakedPath(const std::string& sourcePath)
+{
+	return sourcePath + ".ktx";
+}
+
+uint32_t BakedTexture::GetLevelSize(GLenum format, int width, int height)
+{
+	uint32_t blockBytes = format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT ? 8 : 16;
+	return (uint32_t)((width + 3) / 4) * (uint32_t)((height + 3) / 4) * blockBytes;
+}
+
+void BakedTexture::CompressLevel(const unsigned char* rgba, int width, int height, bool alpha, std::vector<unsigned char>& out)
+{
+	out.resize(GetLevelSize(alpha ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT, width, height));
+	unsigned char* dst = out.data();
+
+	unsigned char block[16 * 4];
+	for (int by = 0; by < height; by += 4)
+	{
+		for (int bx = 0; bx < width; bx += 4)
+		{
+			// the small levels are smaller than a block, repeat the edge pixels
+			for (int y = 0; y < 4; y++)
+			{
+				int sy = by + y < height ? by + y : height - 1;
+				for (int x = 0; x < 4; x++)
+				{
+					int sx = bx + x < width ? bx + x : width - 1;
+					memcpy(&block[(y * 4 + x) * 4], &rgba[(sy * width + sx) * 4], 4);
+				}
+			}
+
+			if (alpha)
+			{
+				CompressAlphaBlock(block, dst);
+				dst += 8;
+			}
+			CompressColorBlock(block, dst);
+			dst += 8;
+		}
+	}
+}
+
+void BakedTexture::Downsample(const unsigned char* rgba, int width, int height, std::vector<unsigned char>& out)
+{
+	int w = width > 1 ? width / 2 : 1;
+	int h = height > 1 ? height / 2 : 1;
+	out.resize((size_t)w * h * 4);
+
+	for (int y = 0; y < h; y++)
+	{
+		int y0 = y * 2 < height ? y * 2 : height - 1;
+		int y1 = y * 2 + 1 < height ? y * 2 + 1 : height - 1;
+		for (int x = 0; x < w; x++)
+		{
+			int x0 = x * 2 < width ? x * 2 : width - 1;
+			int x1 = x * 2 + 1 < width ? x * 2 + 1 : width - 1;
+			for (int c = 0; c < 4; c++)
+			{
+				int sum = rgba[(y0 * width + x0) * 4 + c] + rgba[(y0 * width + x1) * 4 + c] + rgba[(y1 * width + x0) * 4 + c] + rgba[(y1 * width + x1) * 4 + c];
+				out[((size_t)y * w + x) * 4 + c] = (unsigned char)((sum + 2) / 4);
+			}
+		}
+	}
+}
+
+bool BakedTexture::Bake(const std::string& sourcePath)
+{
+	int width, height, channels;
+	unsigned char* pixels = stbi_load(sourcePath.c_str(), &width, &height, &channels, 4);
+	if (pixels == NULL)
+		return false;
+
+	// grey + alpha and RGBA keep their alpha, everything else is opaque
+	bool alpha = channels == 2 || channels == 4;
+
+	Header header;
+	memcpy(header.identifier, KtxIdentifier, sizeof(KtxIdentifier));
+	header.endianness = KtxEndianness;
+	header.glType = 0;
+	header.glTypeSize = 1;
+	header.glFormat = 0;
+	header.glInternalFormat = alpha ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+	header.glBaseInternalFormat = alpha ? GL_RGBA : GL_RGB;
+	header.pixelWidth = width;
+	header.pixelHeight = height;
+	header.pixelDepth = 0;
+	header.numberOfArrayElements = 0;
+	header.numberOfFaces = 1;
+	header.numberOfMipmapLevels = 1;
+	header.bytesOfKeyValueData = 0;
+	for (int size = width > height ? width : height; size > 1; size /= 2)
+		header.numberOfMipmapLevels++;
+
+	FILE* file = fopen(GetBakedPath(sourcePath).c_str(), "wb");
+	if (file == NULL)
+	{
+		stbi_image_free(pixels);
+		return false;
+	}
+	fwrite(&header, sizeof(Header), 1, file);
+
+	std::vector<unsigned char> level(pixels, pixels + (size_t)width * height * 4);
+	std::vector<unsigned char> next;
+	std::vector<unsigned char> compressed;
+	stbi_image_free(pixels);
+
+	int w = width, h = height;
+	for (uint32_t l = 0; l < header.numberOfMipmapLevels; l++)
+	{
+		CompressLevel(level.data(), w, h, alpha, compressed);
+
+		// block sizes are multiples of 4, so the levels need no padding
+		uint32_t imageSize = (uint32_t)compressed.size();
+		fwrite(&imageSize, sizeof(uint32_t), 1, file);
+		fwrite(compressed.data(), 1, compressed.size(), file);
+
+		Downsample(level.data(), w, h, next);
+		level.swap(next);
+		w = w > 1 ? w / 2 : 1;
+		h = h > 1 ? h / 2 : 1;
+	}
+
+	bool ok = ferror(file) == 0;
+	fclose(file);
+	return ok;
+}
+
+int BakedTexture::BakeAll(const std::vector<std::string>& sourcePaths)
+{
+	Headless::Enable();
+
+	std::vector<std::string> paths = sourcePaths;
+	if (paths.empty())
+	{
+		std::error_code error;
+		for (fs::recursive_directory_iterator it("./models", error), end; it != end; it.increment(error))
+		{
+			std::string extension = it->path().extension().string();
+			if (extension == ".png" || extension == ".jpg" || extension == ".jpeg" || extension == ".tga" || extension == ".bmp")
+				paths.push_back(it->path().generic_string());
+		}
+	}
+
+	int failed = 0;
+	for (unsigned int i = 0; i < paths.size(); i++)
+	{
+		if (Bake(paths[i]))
+		{
+			printf("Baked %s\n", GetBakedPath(paths[i]).c_str());
+		}
+		else
+		{
+			printf("Unable to bake %s\n", paths[i].c_str());
+			failed++;
+		}
+	}
+	return failed;
+}
+
+bool BakedTexture::Read(const std::string& sourcePath, DecodedImage& image)
+{
+	// without S3TC the source image is decoded as before
+	if (!GLEW_EXT_texture_compression_s3tc)
+		return false;
+
+	std::string bakedPath = GetBakedPath(sourcePath);
+	if (!BakedMesh::IsUpToDate(sourcePath, bakedPath))
+		return false;
+
+	MappedFile* file = new MappedFile;
+	if (!file->Open(bakedPath) || file->GetSize() < sizeof(Header))
+	{
+		delete file;
+		return false;
+	}
+
+	const Header& header = *(const Header*)file->GetData();
+	bool valid = memcmp(header.identifier, KtxIdentifier, sizeof(KtxIdentifier)) == 0 && header.endianness == KtxEndianness
+		&& (header.glInternalFormat == GL_COMPRESSED_RGB_S3TC_DXT1_EXT || header.glInternalFormat == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT)
+		&& header.pixelWidth > 0 && header.pixelHeight > 0 && header.pixelDepth == 0 && header.numberOfFaces == 1 && header.numberOfArrayElements == 0
+		&& header.numberOfMipmapLevels > 0 && header.numberOfMipmapLevels <= 32;
+
+	// every level has to be there and be as large as its size says
+	size_t offset = sizeof(Header) + header.bytesOfKeyValueData;
+	int w = header.pixelWidth, h = header.pixelHeight;
+	for (uint32_t l = 0; valid && l < header.numberOfMipmapLevels; l++)
+	{
+		if (offset + sizeof(uint32_t) > file->GetSize())
+		{
+			valid = false;
+			break;
+		}
+		uint32_t imageSize = *(const uint32_t*)(file->GetData() + offset);
+		offset += sizeof(uint32_t) + ((imageSize + 3) & ~3u);
+		valid = imageSize == GetLevelSize(header.glInternalFormat, w, h) && offset <= file->GetSize();
+		w = w > 1 ? w / 2 : 1;
+		h = h > 1 ? h / 2 : 1;
+	}
+
+	if (!valid)
+	{
+		printf("BakedTexture: %s is not a supported KTX file, rebake it\n", bakedPath.c_str());
+		delete file;
+		return false;
+	}
+
+	image.pixels = NULL;
+	image.width = header.pixelWidth;
+	image.height = header.pixelHeight;
+	image.channels = header.glBaseInternalFormat == GL_RGBA ? 4 : 3;
+	image.compressedFormat = header.glInternalFormat;
+	image.levels = header.numberOfMipmapLevels;
+	image.compressed = file->GetData() + sizeof(Header) + header.bytesOfKeyValueData;
+	image.mapping = file;
+	return true;
+}
+
+void BakedTexture::Upload(const DecodedImage& image)
+{
+	const unsigned char* level = image.compressed;
+	int w = image.width, h = image.height;
+	for (int l = 0; l < image.levels; l++)
+	{
+		uint32_t imageSize = *(const uint32_t*)level;
+		glCompressedTexImage2D(GL_TEXTURE_2D, l, image.compressedFormat, w, h, 0, imageSize, level + sizeof(uint32_t));
+		level += sizeof(uint32_t) + ((imageSize + 3) & ~3u);
+		w = w > 1 ? w / 2 : 1;
+		h = h > 1 ? h / 2 : 1;
+	}
+
+	// the chain is complete, sample it instead of the single level the stb path uses
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, image.levels - 1);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+}
@@ -0,0 +1,60 @@
+#pragma once
+#ifndef BAKEDTEXTURE_H
+#define BAKEDTEXTURE_H
+
+#include <GL/glew.h>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+struct DecodedImage;
+
+// block compressed textures with their whole mip chain, written by the offline baker (FPS_Game --bake-textures)
+// next to the source image as <source>.ktx (KTX 1.1 container, readable by the usual KTX tools)
+// opaque images are stored as BC1 (DXT1, 4 bits per pixel), images with alpha as BC3 (DXT5, 8 bits per pixel)
+//
+// Model::DecodeImage maps the baked file when it exists and is not older than the source, the levels are
+// handed to glCompressedTexImage2D straight from the mapping, so there is no decoding and no glGenerateMipmap
+class BakedTexture
+{
+public:
+	static std::string GetBakedPath(const std::string& sourcePath);
+
+	// decodes the source with stb_image, builds the mip chain and compresses every level
+	static bool Bake(const std::string& sourcePath);
+	// bakes the given images, or every image below ./models if there are none, returns the number of failures
+	static int BakeAll(const std::vector<std::string>& sourcePaths);
+
+	// maps the baked file of sourcePath into image, false if there is no usable one
+	static bool Read(const std::string& sourcePath, DecodedImage& image);
+	// uploads every level of a baked image to the bound GL_TEXTURE_2D
+	static void Upload(const DecodedImage& image);
+private:
+	struct Header
+	{
+		uint8_t identifier[12];
+		uint32_t endianness;
+		uint32_t glType;
+		uint32_t glTypeSize;
+		uint32_t glFormat;
+		uint32_t glInternalFormat;
+		uint32_t glBaseInternalFormat;
+		uint32_t pixelWidth;
+		uint32_t pixelHeight;
+		uint32_t pixelDepth;
+		uint32_t numberOfArrayElements;
+		uint32_t numberOfFaces;
+		uint32_t numberOfMipmapLevels;
+		uint32_t bytesOfKeyValueData;
+	};
+
+	// bytes of a level in the given format, BC1 and BC3 encode 4x4 blocks into 8 and 16 bytes
+	static uint32_t GetLevelSize(GLenum format, int width, int height);
+
+	// compresses one RGBA8 level, alpha decides between BC3 and BC1
+	static void CompressLevel(const unsigned char* rgba, int width, int height, bool alpha, std::vector<unsigned char>& out);
+	// 2x2 box filter down to the next level
+	static void Downsample(const unsigned char* rgba, int width, int height, std::vector<unsigned char>& out);
+};
+
+#endif
@@ -50,7 +50,9 @@ BoundingSphere::BoundingSphere(ModelNode* gn, const glm::vec3& pos, const float
 	worldCenter.x = pos.x;
 	worldCenter.y = pos.y;
 	worldCenter.z = pos.z;
+	center = pos;
 	this->radius = radius;
+	worldRadius = radius;
 	node = gn;
 }
 // this function is used to transform the bounding sphere to the world coordinates
@@ -69,6 +71,16 @@ const float BoundingSphere::GetRadius() const
 {
 	return radius;
 }
+// this function is used to get the radius of the bounding sphere after the last transform
+const float BoundingSphere::GetWorldRadius() const
+{
+	return worldRadius;
+}
+// the node the bounding sphere belongs to
+ModelNode* BoundingSphere::GetNode() const
+{
+	return node;
+}
 // setter for the world center
 void BoundingSphere::SetWorldCenter(const glm::vec3& center)
 {
@@ -79,26 +91,12 @@ void BoundingSphere::Transform(const glm::mat4& model)
 {
 	worldCenter = model * glm::vec4(center, 1);
 
-	glm::vec3 scale;
-	glm::quat rotation;
-	glm::vec3 translation;
-	glm::vec3 skew;
-	glm::vec4 perspective;
-
-	glm::decompose(model, scale, rotation, translation, skew, perspective);
+	// the length of each basis column is the scale along that axis, cheaper than a full glm::decompose
+	float scaleX = glm::length(glm::vec3(model[0]));
+	float scaleY = glm::length(glm::vec3(model[1]));
+	float scaleZ = glm::length(glm::vec3(model[2]));
 	//multiply the radius with the largest scale (in case of non-uniform scale)
-	if (scale.x > scale.y && scale.x > scale.z)
-	{
-		worldRadius = radius * scale.x;
-	}
-	else if (scale.y > scale.x && scale.y > scale.z)
-	{
-		worldRadius = radius * scale.y;
-	}
-	else
-	{
-		worldRadius = radius * scale.z;
-	}
+	worldRadius = radius * glm::max(scaleX, glm::max(scaleY, scaleZ));
 }
 
 bool BoundingSphere::CollidesWithRay(const glm::vec3& rayOrigin, const glm::vec3& rayDirection, Intersection& hit)
@@ -134,6 +132,8 @@ bool BoundingSphere::CollidesWithRay(const glm::vec3& rayOrigin, const glm::vec3
 	hit.point = rayOrigin + rayDirection * t;
 	hit.intersectedNode = node;
 	hit.distance = t;
+
+	return true;
 }
 
 // =======================================================================
@@ -225,3 +225,56 @@ bool BoundingBox::CollidesWithRay(const glm::vec3& rayOrigin, const glm::vec3& r
 }
 
 
+
+
+Frustum::Frustum()
+{
+	// accepts everything until Extract is called
+	for (int i = 0; i < 6; i++)
+		planes[i] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+}
+
+void Frustum::Extract(const glm::mat4& projView)
+{
+	// Gribb/Hartmann, the planes are sums and differences of the rows of the clip matrix (glm is column major)
+	glm::vec4 row0(projView[0][0], projView[1][0], projView[2][0], projView[3][0]);
+	glm::vec4 row1(projView[0][1], projView[1][1], projView[2][1], projView[3][1]);
+	glm::vec4 row2(projView[0][2], projView[1][2], projView[2][2], projView[3][2]);
+	glm::vec4 row3(projView[0][3], projView[1][3], projView[2][3], projView[3][3]);
+
+	planes[0] = row3 + row0; // left
+	planes[1] = row3 - row0; // right
+	planes[2] = row3 + row1; // bottom
+	planes[3] = row3 - row1; // top
+	planes[4] = row3 + row2; // near
+	planes[5] = row3 - row2; // far
+
+	// normalized so the sphere test can compare against the radius directly
+	for (int i = 0; i < 6; i++)
+		planes[i] /= glm::length(glm::vec3(planes[i]));
+}
+
+bool Frustum::IntersectsSphere(const glm::vec3& center, float radius) const
+{
+	for (int i = 0; i < 6; i++)
+	{
+		if (glm::dot(glm::vec3(planes[i]), center) + planes[i].w < -radius)
+			return false;
+	}
+	return true;
+}
+
+bool Frustum::IntersectsBox(const glm::vec3& minPoint, const glm::vec3& maxPoint) const
+{
+	for (int i = 0; i < 6; i++)
+	{
+		// the corner furthest along the plane normal, if it is outside the whole box is
+		glm::vec3 p(planes[i].x >= 0.0f ? maxPoint.x : minPoint.x,
+			planes[i].y >= 0.0f ? maxPoint.y : minPoint.y,
+			planes[i].z >= 0.0f ? maxPoint.z : minPoint.z);
+
+		if (glm::dot(glm::vec3(planes[i]), p) + planes[i].w < 0.0f)
+			return false;
+	}
+	return true;
+}
@@ -53,6 +53,10 @@ public:
 
 	const float GetRadius() const;
 
+	const float GetWorldRadius() const;
+
+	ModelNode* GetNode() const;
+
 	void Transform(const glm::mat4& model);
 
 	void SetWorldCenter(const glm::vec3& center);
@@ -80,4 +84,20 @@ public:
 	glm::vec3 maxPointWorld;
 };
 
+// the six planes of a view frustum, extracted from a projection * view matrix
+class Frustum
+{
+	// xyz is the inward facing normal, w the distance, a point p is inside when dot(xyz, p) + w >= 0
+	glm::vec4 planes[6];
+
+public:
+	Frustum();
+
+	void Extract(const glm::mat4& projView);
+
+	bool IntersectsSphere(const glm::vec3& center, float radius) const;
+
+	bool IntersectsBox(const glm::vec3& minPoint, const glm::vec3& maxPoint) const;
+};
+
 #endif
@@ -1,20 +1,55 @@
 #include "BulletEngine.h"
 #include "ShaderLibrary.h"
+#include "ResourceCache.h"
 #include <math.h>
 #include "BoundingObjects.h"
 #include "IDamageable.h"
+#include "Profiler.h"
+#include "Headless.h"
 
 // BulletEngine class is used to manage the bullets in the game and to perform raycasting
 
 BulletEngine::BulletEngine(float clipX, float clipZ)
-	: ClipX(clipX), ClipZ(clipZ)
+	: bullets(MaxBullets), ClipX(clipX), ClipZ(clipZ), instanceVBO(0), glCreated(false)
 	// BulletEngine constructor initializes the clipX and clipZ values and loads the bullet model
 {
-	// initialize the bullet velocity and the threshold values and reserve memory for the bullets
+	// the bullet pool and the instance matrices are allocated once for MaxBullets
 	// you can also change the bullet model and the shader
-	bulletShdr = ShaderLibrary::GetInstance()->GetShader("bullet");
-	bulletModel.LoadModel("./models/bullet_new/shareablebullet.obj");
-	shotBullets.reserve(100);
+	// shaders/bullet_instanced takes the model matrix of every bullet from its instanceModel attribute
+	// headless runs never draw, there is no shader to look up or warn about
+	bulletShdr = NULL;
+	if (!Headless::IsEnabled())
+	{
+		bulletShdr = ShaderLibrary::GetInstance()->GetShader("bullet_instanced");
+		if (bulletShdr == NULL || !bulletShdr->isInstanced())
+			printf("BulletEngine: the bullet_instanced shader is missing or has no instanceModel attribute, bullets are not drawn\n");
+	}
+	bulletModel = ResourceCache::GetInstance()->GetModel("./models/bullet_new/shareablebullet.obj");
+	instanceMatrices.resize(MaxBullets);
+}
+
+void BulletEngine::CreateGLObjects()
+{
+	glGenBuffers(1, &instanceVBO);
+	glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+	glBufferData(GL_ARRAY_BUFFER, MaxBullets * sizeof(glm::mat4), NULL, GL_STREAM_DRAW);
+
+	// the buffer keeps its name when it is orphaned, so the bullet VAOs point at it once and for all
+	GLint modelLoc = bulletShdr->getInstanceModelAttrib();
+	for (unsigned int m = 0; m < bulletModel->meshes.size(); m++)
+	{
+		glBindVertexArray(bulletModel->meshes[m].VAO);
+		for (int c = 0; c < 4; c++)
+		{
+			glEnableVertexAttribArray(modelLoc + c);
+			glVertexAttribPointer(modelLoc + c, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(c * sizeof(glm::vec4)));
+			glVertexAttribDivisor(modelLoc + c, 1);
+		}
+	}
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	glCreated = true;
 }
 
 
@@ -35,152 +70,72 @@ void BulletEngine::ScreenCenterToWorldRay(glm::mat4 viewMatrix, glm::mat4 projMa
 }
 
 // this function is used to shoot a bullet in the game it takes the world direction, the origin of the bullet and the yaw and pitch of the bullet
-// it also performs the raycasting and checks if the bullet intersects with any object in the game
-void BulletEngine::Shoot(glm::vec3 worldDirection, glm::vec3 origin, float yaw, float pitch)
+// nothing is hit here, Update sweeps the bullet through the scene tick by tick
+void BulletEngine::Shoot(glm::vec3 worldDirection, glm::vec3 origin, float yaw, float pitch, const SceneNode* shooter)
 {
-	Bullet blt;
-	blt.direction = worldDirection;
-	blt.position = origin;
-	blt.clipped = false;
-	blt.yaw = yaw;
-	blt.pitch = pitch;
-	// perform raycast from the origin of the bullet
+	bullets.Spawn(origin, worldDirection, yaw, pitch, shooter);
+}
 
-	std::vector<Intersection*> inters;
-	SceneGraph->TraverseIntersection(origin, worldDirection, inters);
+void BulletEngine::Update(float delta)
 
-	// if the bullet intersects with an object, find the minimum intersect and decrease the health of the object
+{
+	PROFILE_ZONE("BulletEngine::Update");
 
-	if (inters.size() > 0)
-	{
-		//printf("===Intersected!\n");
+	// bring the BVH up to date with this tick's transforms (zombies rotate every tick)
+	sceneBVH.Refit(SceneGraph);
+
+	float distance = delta * BulletVelocity;
 
-		// find minimum intersect
-		Intersection* minIntersect = inters[0];
+	// sweep the segment every bullet covers during this tick, so a bullet can't pass through anything however fast it is
+	// walk from the back, Remove moves the last bullet into the hole and that one has been swept already
+	for (int i = bullets.GetCount() - 1; i >= 0; i--)
+	{
+		Intersection minIntersect;
 
-		for (auto i = inters.begin(); i != inters.end(); ++i)
+		if (sceneBVH.Raycast(bullets.GetPosition(i), bullets.GetDirection(i) * distance, 1.0f, bullets.GetShooter(i), minIntersect))
 		{
-			if ((*i)->distance < minIntersect->distance)
+			// the bullet stops at the first thing it hits, so every hit is resolved exactly once
+			IDamageable* damageable = dynamic_cast<IDamageable*>(minIntersect.intersectedNode);
+			if (damageable != NULL)
 			{
-				minIntersect = *i;
+				damageable->DecreaseHealth();
 			}
-		}
-
-		// print the path of the intersection
-
-		std::vector<SceneNode*> path = minIntersect->intersectionPath;
-		for (auto it = path.begin(); it != path.end(); ++it)
-		{
-			//printf("->%s", (*it)->NodeName.c_str());
-		}
-		//printf("\n");
-		// set the intersected node and decrease the health of the object
-		blt.intersectedNode = minIntersect->intersectedNode;
-
-		IDamageable* damageable = dynamic_cast<IDamageable*>(minIntersect->intersectedNode);
-		if (damageable != NULL)
-		{
-			damageable->DecreaseHealth();
+			bullets.Remove(i);
 		}
 	}
-	else
-	{
-		blt.intersectedNode = NULL;
-	}
 
-	shotBullets.push_back(blt);
+	// move the remaining bullets and drop the ones that left the level
+	bullets.Integrate(distance, ClipX, ClipZ);
 }
 
-void BulletEngine::Update(float delta)
-
+// every live bullet in one instanced draw per bullet mesh
+void BulletEngine::Visualize()
 {
-	// update bullet positions
-	for (auto it = shotBullets.begin(); it != shotBullets.end(); ++it)
-	{
-		if ((*it).clipped)
-			continue;
-		// move bullet in the direction of the bullet
-		(*it).position += (*it).direction * delta * BulletVelocity;
-		if (fabs((*it).position.x) > ClipX || fabs((*it).position.z) > ClipZ)
-		{
-			(*it).clipped = true;
-			continue;
-		}
-
-		// perform raycast from current bullet position
-		// if struck object doesn't match, clip bullet
-		if (deltaClip >= BulletRaycastThreshold && (*it).intersectedNode != NULL)
-		{
-			std::vector<Intersection*> inters;
-			SceneGraph->TraverseIntersection((*it).position, (*it).direction, inters);
+	int count = bullets.GetCount();
+	if (count == 0 || !bulletModel->IsReady())
+		return;
+	if (bulletShdr == NULL || !bulletShdr->isInstanced())
+		return;
 
-			if (inters.size() > 0)
-			{
-				// find minimum intersect
-				Intersection* minIntersect = inters[0];
-
-				for (auto i = inters.begin(); i != inters.end(); ++i)
-				{
-					if ((*i)->distance < minIntersect->distance)
-					{
-						minIntersect = *i;
-					}
-				}
-
-				if ((*it).intersectedNode != minIntersect->intersectedNode)
-					(*it).clipped = true;
-			}
-			else if ((*it).intersectedNode != NULL)
-			{ 
-				(*it).clipped = true;
-			}
-		}
-	}
+	if (!glCreated)
+		CreateGLObjects();
 
-	// free clipped bullets
+	bullets.BuildMatrices(BulletScale, instanceMatrices.data());
 
-	if (deltaClip >= ClipThreshold)
-	{
-		FreeClippedBullets();
-		deltaClip = 0;
-	}
+	// orphan the buffer so the driver hands out fresh storage instead of waiting for last frame's draw
+	// only as much as this frame's bullets need, a handful of bullets shouldn't cost a MaxBullets sized allocation
+	glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+	glBufferData(GL_ARRAY_BUFFER, count * sizeof(glm::mat4), instanceMatrices.data(), GL_STREAM_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-	deltaClip += delta;
-}
+	bulletShdr->use();
+	bulletShdr->setVec3(Shader::UNIFORM_COLOR, 1.0f, 0.0f, 0.0f);
 
-void BulletEngine::FreeClippedBullets()
-{
-	for (int i = 0; i < shotBullets.size(); i++)
+	for (unsigned int m = 0; m < bulletModel->meshes.size(); m++)
 	{
-		// free clipped bullets
-		if (!shotBullets[i].clipped)
-			continue;
-
-		shotBullets.erase(shotBullets.begin() + i);
+		const Mesh& mesh = bulletModel->meshes[m];
+		glBindVertexArray(mesh.VAO);
+		glDrawElementsInstanced(GL_TRIANGLES, (GLsizei)mesh.indices.size(), mesh.GetIndexType(), 0, count);
 	}
+	glBindVertexArray(0);
 }
-
-void BulletEngine::Visualize()
-{
-	// visualize the bullets in the game
-	for (auto it = shotBullets.begin(); it != shotBullets.end(); ++it)
-	{
-		// if the bullet is clipped, don't visualize it
-		if ((*it).clipped)
-			continue;
-		// visualize the bullet
-		bulletShdr->use();
-		glm::mat4 transformM = glm::translate(glm::mat4(1.0f), (*it).position);
-		// rotate the bullet according to the yaw and pitch
-		transformM = glm::rotate(transformM, glm::radians(-(*it).yaw), glm::vec3(0.0f, 1.0f, 0.0f)); 
-		transformM = glm::rotate(transformM, glm::radians((*it).pitch), glm::vec3(1.0f, 0.0f, 0.0f));
-		float scaleFactor = 0.01f; // replace with the desired scale factor
-		transformM = glm::scale(transformM, glm::vec3(scaleFactor, scaleFactor, scaleFactor));
-
-		bulletShdr->setMat4("model", transformM);
-
-
-		bulletShdr->setVec3("color", 1.0f, 0.0f, 0.0f);
-		bulletModel.Draw(*bulletShdr);
-	}
-}
\ No newline at end of file
@@ -7,18 +7,8 @@
 #include "Model.h"
 #include "Shader.h"
 #include "SceneNode.h"
-
-class Bullet
-{
-public:
-	glm::vec3 position;
-	glm::vec3 direction;
-	float yaw;
-	float pitch;
-
-	bool clipped;
-	SceneNode* intersectedNode;
-};
+#include "SceneBVH.h"
+#include "BulletPool.h"
 
 class BulletEngine
 {
@@ -31,24 +21,32 @@ public:
 
 	static void ScreenCenterToWorldRay(glm::mat4 viewMatrix, glm::mat4 projMatrix, glm::vec3& outDir);
 	
-	void Shoot(glm::vec3 worldDirection, glm::vec3 origin, float yaw, float pitch);
+	// the bullet is swept against the scene on every Update, hits are resolved when the bullet actually gets there
+	void Shoot(glm::vec3 worldDirection, glm::vec3 origin, float yaw, float pitch, const SceneNode* shooter = NULL);
 
 private:
-	std::vector<Bullet> shotBullets;
+	// every bullet in flight, hit and out of bounds bullets are removed in the tick it happens
+	BulletPool bullets;
+	static const int MaxBullets = 16384;
 
 	const float ClipX;
 	const float ClipZ;
 
-	Model bulletModel;
+	std::shared_ptr<Model> bulletModel;
 	Shader* bulletShdr;
 
-	const float BulletVelocity = 100.0f; //30 dbg 100 real
-	const int ClipThreshold = 15.0f;
-	const float BulletRaycastThreshold = 0.5f;
+	// bullets are drawn instanced, the model matrices of all of them are streamed into instanceVBO every frame
+	GLuint instanceVBO;
+	std::vector<glm::mat4> instanceMatrices;
+	bool glCreated;
+	const float BulletScale = 0.01f;
 
-	float deltaClip = 0.0f;
+	// acceleration structure over SceneGraph, refitted once per Update before the bullets are swept through it
+	SceneBVH sceneBVH;
+
+	const float BulletVelocity = 100.0f; //30 dbg 100 real
 
-	void FreeClippedBullets();
+	void CreateGLObjects();
 };
 
 
@@ -0,0 +1,206 @@
+#include "BulletPool.h"
+#include <math.h>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define BULLETPOOL_AVX
+#define BULLETPOOL_SSE
+#elif defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#include <emmintrin.h>
+#define BULLETPOOL_SSE
+#endif
+
+BulletPool::BulletPool(int capacity)
+	: count(0), capacity(capacity)
+{
+	posX.resize(capacity); posY.resize(capacity); posZ.resize(capacity);
+	dirX.resize(capacity); dirY.resize(capacity); dirZ.resize(capacity);
+	sinYaw.resize(capacity); cosYaw.resize(capacity);
+	sinPitch.resize(capacity); cosPitch.resize(capacity);
+	shooters.resize(capacity);
+	clipped.reserve(capacity);
+}
+
+int BulletPool::GetCount() const
+{
+	return count;
+}
+
+int BulletPool::GetCapacity() const
+{
+	return capacity;
+}
+
+bool BulletPool::Spawn(const glm::vec3& position, const glm::vec3& direction, float yaw, float pitch, const SceneNode* shooter)
+{
+	if (count == capacity)
+		return false;
+
+	int i = count++;
+	posX[i] = position.x; posY[i] = position.y; posZ[i] = position.z;
+	dirX[i] = direction.x; dirY[i] = direction.y; dirZ[i] = direction.z;
+	// yaw and pitch are in degrees, the model is turned by -yaw around y
+	float yawRad = glm::radians(-yaw);
+	float pitchRad = glm::radians(pitch);
+	sinYaw[i] = sinf(yawRad); cosYaw[i] = cosf(yawRad);
+	sinPitch[i] = sinf(pitchRad); cosPitch[i] = cosf(pitchRad);
+	shooters[i] = shooter;
+	return true;
+}
+
+void BulletPool::Remove(int i)
+{
+	int last = --count;
+	if (i == last)
+		return;
+
+	posX[i] = posX[last]; posY[i] = posY[last]; posZ[i] = posZ[last];
+	dirX[i] = dirX[last]; dirY[i] = dirY[last]; dirZ[i] = dirZ[last];
+	sinYaw[i] = sinYaw[last]; cosYaw[i] = cosYaw[last];
+	sinPitch[i] = sinPitch[last]; cosPitch[i] = cosPitch[last];
+	shooters[i] = shooters[last];
+}
+
+void BulletPool::Integrate(float distance, float clipX, float clipZ)
+{
+	clipped.clear();
+	int i = 0;
+
+#if defined(BULLETPOOL_AVX)
+	{
+		__m256 d = _mm256_set1_ps(distance);
+		__m256 cx = _mm256_set1_ps(clipX);
+		__m256 cz = _mm256_set1_ps(clipZ);
+		// clearing the sign bit is fabs
+		__m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+
+		for (; i + 8 <= count; i += 8)
+		{
+			__m256 x = _mm256_add_ps(_mm256_loadu_ps(&posX[i]), _mm256_mul_ps(_mm256_loadu_ps(&dirX[i]), d));
+			__m256 y = _mm256_add_ps(_mm256_loadu_ps(&posY[i]), _mm256_mul_ps(_mm256_loadu_ps(&dirY[i]), d));
+			__m256 z = _mm256_add_ps(_mm256_loadu_ps(&posZ[i]), _mm256_mul_ps(_mm256_loadu_ps(&dirZ[i]), d));
+			_mm256_storeu_ps(&posX[i], x);
+			_mm256_storeu_ps(&posY[i], y);
+			_mm256_storeu_ps(&posZ[i], z);
+
+			__m256 out = _mm256_or_ps(_mm256_cmp_ps(_mm256_and_ps(x, absMask), cx, _CMP_GT_OQ), _mm256_cmp_ps(_mm256_and_ps(z, absMask), cz, _CMP_GT_OQ));
+			int mask = _mm256_movemask_ps(out);
+			for (int lane = 0; mask != 0; lane++, mask >>= 1)
+			{
+				if (mask & 1)
+					clipped.push_back(i + lane);
+			}
+		}
+	}
+#endif
+
+#if defined(BULLETPOOL_SSE)
+	{
+		__m128 d = _mm_set1_ps(distance);
+		__m128 cx = _mm_set1_ps(clipX);
+		__m128 cz = _mm_set1_ps(clipZ);
+		__m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128 x = _mm_add_ps(_mm_loadu_ps(&posX[i]), _mm_mul_ps(_mm_loadu_ps(&dirX[i]), d));
+			__m128 y = _mm_add_ps(_mm_loadu_ps(&posY[i]), _mm_mul_ps(_mm_loadu_ps(&dirY[i]), d));
+			__m128 z = _mm_add_ps(_mm_loadu_ps(&posZ[i]), _mm_mul_ps(_mm_loadu_ps(&dirZ[i]), d));
+			_mm_storeu_ps(&posX[i], x);
+			_mm_storeu_ps(&posY[i], y);
+			_mm_storeu_ps(&posZ[i], z);
+
+			__m128 out = _mm_or_ps(_mm_cmpgt_ps(_mm_and_ps(x, absMask), cx), _mm_cmpgt_ps(_mm_and_ps(z, absMask), cz));
+			int mask = _mm_movemask_ps(out);
+			for (int lane = 0; mask != 0; lane++, mask >>= 1)
+			{
+				if (mask & 1)
+					clipped.push_back(i + lane);
+			}
+		}
+	}
+#endif
+
+	for (; i < count; i++)
+	{
+		posX[i] += dirX[i] * distance;
+		posY[i] += dirY[i] * distance;
+		posZ[i] += dirZ[i] * distance;
+
+		if (fabsf(posX[i]) > clipX || fabsf(posZ[i]) > clipZ)
+			clipped.push_back(i);
+	}
+
+	// clipped is ascending, removing from the back means the bullet swapped into a hole was never flagged
+	for (int k = (int)clipped.size() - 1; k >= 0; k--)
+		Remove(clipped[k]);
+}
+
+// rotate(-yaw, y) * rotate(pitch, x) written out, the columns are
+//	( cy, 0, -sy)	(sy * sp, cp, cy * sp)	(sy * cp, -sp, cy * cp)
+void BulletPool::BuildMatrices(float scale, glm::mat4* out) const
+{
+	float* m = &out[0][0][0];
+	int i = 0;
+
+#if defined(BULLETPOOL_SSE)
+	{
+		__m128 s = _mm_set1_ps(scale);
+		__m128 zero = _mm_setzero_ps();
+		__m128 one = _mm_set1_ps(1.0f);
+
+		// the lanes hold 4 bullets, transposing 4 such vectors gives the same column of 4 matrices
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128 sy = _mm_mul_ps(_mm_loadu_ps(&sinYaw[i]), s);
+			__m128 cy = _mm_mul_ps(_mm_loadu_ps(&cosYaw[i]), s);
+			__m128 sp = _mm_loadu_ps(&sinPitch[i]);
+			__m128 cp = _mm_loadu_ps(&cosPitch[i]);
+
+			__m128 c0x = cy, c0y = zero, c0z = _mm_sub_ps(zero, sy), c0w = zero;
+			__m128 c1x = _mm_mul_ps(sy, sp), c1y = _mm_mul_ps(cp, s), c1z = _mm_mul_ps(cy, sp), c1w = zero;
+			__m128 c2x = _mm_mul_ps(sy, cp), c2y = _mm_sub_ps(zero, _mm_mul_ps(sp, s)), c2z = _mm_mul_ps(cy, cp), c2w = zero;
+			__m128 c3x = _mm_loadu_ps(&posX[i]), c3y = _mm_loadu_ps(&posY[i]), c3z = _mm_loadu_ps(&posZ[i]), c3w = one;
+
+			_MM_TRANSPOSE4_PS(c0x, c0y, c0z, c0w);
+			_MM_TRANSPOSE4_PS(c1x, c1y, c1z, c1w);
+			_MM_TRANSPOSE4_PS(c2x, c2y, c2z, c2w);
+			_MM_TRANSPOSE4_PS(c3x, c3y, c3z, c3w);
+
+			// after the transpose cNx is column N of bullet i, cNy of bullet i + 1 and so on
+			float* dst = m + i * 16;
+			_mm_storeu_ps(dst + 0, c0x);  _mm_storeu_ps(dst + 4, c1x);  _mm_storeu_ps(dst + 8, c2x);  _mm_storeu_ps(dst + 12, c3x);
+			_mm_storeu_ps(dst + 16, c0y); _mm_storeu_ps(dst + 20, c1y); _mm_storeu_ps(dst + 24, c2y); _mm_storeu_ps(dst + 28, c3y);
+			_mm_storeu_ps(dst + 32, c0z); _mm_storeu_ps(dst + 36, c1z); _mm_storeu_ps(dst + 40, c2z); _mm_storeu_ps(dst + 44, c3z);
+			_mm_storeu_ps(dst + 48, c0w); _mm_storeu_ps(dst + 52, c1w); _mm_storeu_ps(dst + 56, c2w); _mm_storeu_ps(dst + 60, c3w);
+		}
+	}
+#endif
+
+	for (; i < count; i++)
+	{
+		float sy = sinYaw[i] * scale, cy = cosYaw[i] * scale;
+		float sp = sinPitch[i], cp = cosPitch[i];
+
+		float* dst = m + i * 16;
+		dst[0] = cy;		dst[1] = 0.0f;			dst[2] = -sy;		dst[3] = 0.0f;
+		dst[4] = sy * sp;	dst[5] = cp * scale;	dst[6] = cy * sp;	dst[7] = 0.0f;
+		dst[8] = sy * cp;	dst[9] = -sp * scale;	dst[10] = cy * cp;	dst[11] = 0.0f;
+		dst[12] = posX[i];	dst[13] = posY[i];		dst[14] = posZ[i];	dst[15] = 1.0f;
+	}
+}
+
+glm::vec3 BulletPool::GetPosition(int i) const
+{
+	return glm::vec3(posX[i], posY[i], posZ[i]);
+}
+
+glm::vec3 BulletPool::GetDirection(int i) const
+{
+	return glm::vec3(dirX[i], dirY[i], dirZ[i]);
+}
+
+const SceneNode* BulletPool::GetShooter(int i) const
+{
+	return shooters[i];
+}
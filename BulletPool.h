@@ -0,0 +1,48 @@
+#pragma once
+#ifndef BULLETPOOL_H
+#define BULLETPOOL_H
+
+#include <glm/glm.hpp>
+#include <vector>
+
+class SceneNode;
+
+// fixed capacity pool of live bullets stored as separate component arrays
+// live bullets are always packed at [0, count), Remove moves the last one into the hole so removal is O(1) and the order is not kept
+// nothing is allocated after construction
+class BulletPool
+{
+public:
+	BulletPool(int capacity);
+
+	// false if the pool is full, the shot is dropped
+	bool Spawn(const glm::vec3& position, const glm::vec3& direction, float yaw, float pitch, const SceneNode* shooter);
+	void Remove(int i);
+
+	// moves every live bullet distance units along its direction and removes the ones that left the |x| <= clipX, |z| <= clipZ area
+	void Integrate(float distance, float clipX, float clipZ);
+
+	// model matrix translate(position) * rotate(-yaw, y) * rotate(pitch, x) * scale(scale) of every live bullet, out needs GetCount() entries
+	void BuildMatrices(float scale, glm::mat4* out) const;
+
+	int GetCount() const;
+	int GetCapacity() const;
+
+	glm::vec3 GetPosition(int i) const;
+	glm::vec3 GetDirection(int i) const;
+	const SceneNode* GetShooter(int i) const;
+private:
+	int count;
+	int capacity;
+
+	std::vector<float> posX, posY, posZ;
+	std::vector<float> dirX, dirY, dirZ;
+	// the orientation never changes in flight, its sines and cosines are taken once on Spawn
+	std::vector<float> sinYaw, cosYaw, sinPitch, cosPitch;
+	std::vector<const SceneNode*> shooters;
+
+	// indices flagged by Integrate, removed afterwards from the highest down so no flagged bullet gets swapped into a hole
+	std::vector<int> clipped;
+};
+
+#endif
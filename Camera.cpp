@@ -37,6 +37,13 @@ glm::mat4 Camera::GetViewMatrix()
 	return glm::lookAt(pos, pos + front, up); //up
 }
 
+// same view matrix but from a different eye position, used to render the interpolated position between two simulation ticks
+
+glm::mat4 Camera::GetViewMatrix(const glm::vec3& eyePos)
+{
+	return glm::lookAt(eyePos, eyePos + front, up);
+}
+
 // getorthogonal matrix is used to get the orthogonal matrix
 
 glm::mat4 Camera::GetOrthogonalMatrix()
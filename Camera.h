@@ -48,6 +48,7 @@ public:
 	Camera(float posX, float posY, float posZ, float upX, float upY, float upZ, float yaw, float pitch);
 
 	glm::mat4 GetViewMatrix();
+	glm::mat4 GetViewMatrix(const glm::vec3& eyePos);
 	glm::mat4 GetProjectionMatrix();
 	glm::mat4 GetOrthogonalMatrix();
 
@@ -17,7 +17,15 @@
 #include "GLErrorLogger.h"
 #include "Terrain.h"
 #include "ZombieNode.h"
+#include "Headless.h"
+#include "AssetLoader.h"
+#include "Profiler.h"
+#include "AllocationCounter.h"
+#include "RenderQueue.h"
+#include "TransformHierarchy.h"
 #include <vector>
+#include <chrono>
+#include <cmath>
 
 //#define FPS_COUNT
 
@@ -42,6 +50,47 @@ void Engine::Start()
 	Update();
 }
 
+void Engine::SetSimulationRate(float hz)
+{
+	// a zero, negative or garbage rate would make the accumulator loop never tick or never end
+	if (!std::isfinite(hz) || hz <= 0.0f)
+	{
+		printf("Invalid simulation rate %f, using %.0f Hz\n", hz, DefaultSimulationRate);
+		hz = DefaultSimulationRate;
+	}
+	deltaTime = 1.0f / hz;
+}
+
+void Engine::StartHeadless(int ticks, float tickRate)
+{
+	Headless::Enable();
+	SetSimulationRate(tickRate);
+
+	if (!InitHeadless())
+	{
+		printf("Fatal error when initializing headless engine! Quitting...\n");
+		return;
+	}
+
+	CreateScene();
+	// the simulation needs the bounds of every model from the first tick, wait for the imports (they still run in parallel)
+	AssetLoader::GetInstance()->Finish();
+	UpdateHeadless(ticks);
+
+	AssetLoader::GetInstance()->Shutdown();
+}
+
+bool Engine::InitHeadless()
+{
+	// no window, the projection only matters for ScreenCenterToWorldRay so any fixed size will do
+	player->camera->SetProjectionMatrix(glm::radians(45.0f), 1920, 1080, 0.1f, 100.0f);
+
+	// shaders are not loaded, ModelNode::AutoLoadShader just gets NULL which is never used headless
+	bulletEngine = new BulletEngine(250, 250);
+
+	return true;
+}
+
 bool Engine::Init()
 {
 	bool success = true;
@@ -163,12 +212,10 @@ void Engine::CreateScene()
 
 	//ModelNode* zombie = new ModelNode("zombie", "./models/zombie/zombie.obj");
 	TransformNode* trZombie = new TransformNode("zombie_transf");
-	trZombie->translateVector = glm::vec3(1.0f, -1.0f, 3.0f);
-	trZombie->rotateVector2 = glm::vec3(1.0f, 0.0f, 0.0f);
-	trZombie->rotateAngleRad2 = glm::radians(-90.0f);
-	trZombie->rotateVector = glm::vec3(0.0f, 0.0f, 1.0f);
-	trZombie->rotateAngleRad = glm::radians(-160.0f);
-	trZombie->scaleVector = glm::vec3(0.12f, 0.12f, 0.12f);
+	trZombie->SetTranslation(glm::vec3(1.0f, -1.0f, 3.0f));
+	trZombie->SetRotation2(glm::vec3(1.0f, 0.0f, 0.0f), glm::radians(-90.0f));
+	trZombie->SetRotation(glm::vec3(0.0f, 0.0f, 1.0f), glm::radians(-160.0f));
+	trZombie->SetScale(glm::vec3(0.12f, 0.12f, 0.12f));
 
 	// create zombie node
 
@@ -182,7 +229,6 @@ void Engine::CreateScene()
 	
 
 	ModelNode* crate = new ModelNode("crate", "./models/crate/Crate.obj");	
-	crate->SetTexture("./models/crate/Textures/1024/A.png");
 
 
 	ModelNode* crateNode = new ModelNode("crate", "./models/crate/Crate.obj");
@@ -261,128 +307,128 @@ void Engine::CreateScene()
 	float crateScaleFactor = 0.005f;
 	float crateScaleFactor2 = 0.005f / 4;
 
-	trCrate->translateVector = glm::vec3(3.0f, -1.0f, 10.0f);
-	trCrate->scaleVector = glm::vec3(crateScaleFactor2, crateScaleFactor2, crateScaleFactor2);
+	trCrate->SetTranslation(glm::vec3(3.0f, -1.0f, 10.0f));
+	trCrate->SetScale(glm::vec3(crateScaleFactor2, crateScaleFactor2, crateScaleFactor2));
 	trCrate->AddNode(crate);
 
-	trCrate2->translateVector = glm::vec3(3.0f, -1.0f, -5.0f);
-	trCrate2->scaleVector = glm::vec3(crateScaleFactor/3, crateScaleFactor/3, crateScaleFactor/3);
+	trCrate2->SetTranslation(glm::vec3(3.0f, -1.0f, -5.0f));
+	trCrate2->SetScale(glm::vec3(crateScaleFactor/3, crateScaleFactor/3, crateScaleFactor/3));
 	trCrate2->AddNode(crate);
 
-	trCrate3->translateVector = glm::vec3(-4.0f, -1.0f, -6.0f);
-	trCrate3->scaleVector = glm::vec3(crateScaleFactor2, crateScaleFactor2, crateScaleFactor2);
+	trCrate3->SetTranslation(glm::vec3(-4.0f, -1.0f, -6.0f));
+	trCrate3->SetScale(glm::vec3(crateScaleFactor2, crateScaleFactor2, crateScaleFactor2));
 	trCrate3->AddNode(crate);
 
-	trCrate4->translateVector = glm::vec3(0.0f, -1.0f, 12.0f);
-	trCrate4->scaleVector = glm::vec3(crateScaleFactor2, crateScaleFactor2, crateScaleFactor2);
+	trCrate4->SetTranslation(glm::vec3(0.0f, -1.0f, 12.0f));
+	trCrate4->SetScale(glm::vec3(crateScaleFactor2, crateScaleFactor2, crateScaleFactor2));
 	trCrate4->AddNode(crate);
 
 	float objectWidth = crateScaleFactor;
 
 
-	trCrate5->translateVector = glm::vec3(19.0f, -1.0f, 0.0f);
-	trCrate5->scaleVector = glm::vec3(crateScaleFactor*2, crateScaleFactor*2, crateScaleFactor*2);
+	trCrate5->SetTranslation(glm::vec3(19.0f, -1.0f, 0.0f));
+	trCrate5->SetScale(glm::vec3(crateScaleFactor*2, crateScaleFactor*2, crateScaleFactor*2));
 	trCrate5->AddNode(crate);
 
-	trCrate6->translateVector = glm::vec3(19.0f, -1.0f, 1.8f);
-	trCrate6->scaleVector = glm::vec3(crateScaleFactor * 2, crateScaleFactor * 2, crateScaleFactor * 2);
+	trCrate6->SetTranslation(glm::vec3(19.0f, -1.0f, 1.8f));
+	trCrate6->SetScale(glm::vec3(crateScaleFactor * 2, crateScaleFactor * 2, crateScaleFactor * 2));
 	trCrate6->AddNode(crate);
 
-	trCrate7->translateVector = glm::vec3(19.0f, -1.0f, 3.6f);
-	trCrate7->scaleVector = glm::vec3(crateScaleFactor * 2, crateScaleFactor * 2, crateScaleFactor * 2);
+	trCrate7->SetTranslation(glm::vec3(19.0f, -1.0f, 3.6f));
+	trCrate7->SetScale(glm::vec3(crateScaleFactor * 2, crateScaleFactor * 2, crateScaleFactor * 2));
 	trCrate7->AddNode(crate);
 
-	trCrate8->translateVector = glm::vec3(19.0f, -1.0f, 5.4f);
-	trCrate8->scaleVector = glm::vec3(crateScaleFactor * 2, crateScaleFactor * 2, crateScaleFactor * 2);
+	trCrate8->SetTranslation(glm::vec3(19.0f, -1.0f, 5.4f));
+	trCrate8->SetScale(glm::vec3(crateScaleFactor * 2, crateScaleFactor * 2, crateScaleFactor * 2));
 	trCrate8->AddNode(crate);
 
-	trCrate9->translateVector = glm::vec3(19.0f, -1.0f, 7.2f);
-	trCrate9->scaleVector = glm::vec3(crateScaleFactor * 2, crateScaleFactor * 2, crateScaleFactor * 2);
+	trCrate9->SetTranslation(glm::vec3(19.0f, -1.0f, 7.2f));
+	trCrate9->SetScale(glm::vec3(crateScaleFactor * 2, crateScaleFactor * 2, crateScaleFactor * 2));
 	trCrate9->AddNode(crate);
 
-	trCrate10->translateVector = glm::vec3(19.0f, -1.0f, 9.0f);
-	trCrate10->scaleVector = glm::vec3(crateScaleFactor * 2, crateScaleFactor * 2, crateScaleFactor * 2);
+	trCrate10->SetTranslation(glm::vec3(19.0f, -1.0f, 9.0f));
+	trCrate10->SetScale(glm::vec3(crateScaleFactor * 2, crateScaleFactor * 2, crateScaleFactor * 2));
 	trCrate10->AddNode(crate);
 
-	trCrate11->translateVector = glm::vec3(19.0f, 0.7f, 0.9f);
-	trCrate11->scaleVector = glm::vec3(crateScaleFactor * 2, crateScaleFactor * 2, crateScaleFactor * 2);
+	trCrate11->SetTranslation(glm::vec3(19.0f, 0.7f, 0.9f));
+	trCrate11->SetScale(glm::vec3(crateScaleFactor * 2, crateScaleFactor * 2, crateScaleFactor * 2));
 	trCrate11->AddNode(crate);
 
-	trCrate12->translateVector = glm::vec3(19.0f, 0.7f, 2.7f);
-	trCrate12->scaleVector = glm::vec3(crateScaleFactor * 2, crateScaleFactor * 2, crateScaleFactor * 2);
+	trCrate12->SetTranslation(glm::vec3(19.0f, 0.7f, 2.7f));
+	trCrate12->SetScale(glm::vec3(crateScaleFactor * 2, crateScaleFactor * 2, crateScaleFactor * 2));
 	trCrate12->AddNode(crate);
 
-	trCrate13->translateVector = glm::vec3(19.0f, 0.7f, 4.5f);
-	trCrate13->scaleVector = glm::vec3(crateScaleFactor * 2, crateScaleFactor * 2, crateScaleFactor * 2);
+	trCrate13->SetTranslation(glm::vec3(19.0f, 0.7f, 4.5f));
+	trCrate13->SetScale(glm::vec3(crateScaleFactor * 2, crateScaleFactor * 2, crateScaleFactor * 2));
 	trCrate13->AddNode(crate);
 
-	trCrate14->translateVector = glm::vec3(19.0f, 0.7f, 6.3f);
-	trCrate14->scaleVector = glm::vec3(crateScaleFactor * 2, crateScaleFactor * 2, crateScaleFactor * 2);
+	trCrate14->SetTranslation(glm::vec3(19.0f, 0.7f, 6.3f));
+	trCrate14->SetScale(glm::vec3(crateScaleFactor * 2, crateScaleFactor * 2, crateScaleFactor * 2));
 	trCrate14->AddNode(crate);
 
-	trCrate15->translateVector = glm::vec3(19.0f, 0.7f, 8.1f);
-	trCrate15->scaleVector = glm::vec3(crateScaleFactor * 2, crateScaleFactor * 2, crateScaleFactor * 2);
+	trCrate15->SetTranslation(glm::vec3(19.0f, 0.7f, 8.1f));
+	trCrate15->SetScale(glm::vec3(crateScaleFactor * 2, crateScaleFactor * 2, crateScaleFactor * 2));
 	trCrate15->AddNode(crate);
 
-	trCrate16->translateVector = glm::vec3(19.0f, 2.4f, 2.3f);
-	trCrate16->scaleVector = glm::vec3(crateScaleFactor * 2, crateScaleFactor * 2, crateScaleFactor * 2);
+	trCrate16->SetTranslation(glm::vec3(19.0f, 2.4f, 2.3f));
+	trCrate16->SetScale(glm::vec3(crateScaleFactor * 2, crateScaleFactor * 2, crateScaleFactor * 2));
 	trCrate16->AddNode(crate);
 
-	trCrate17->translateVector = glm::vec3(19.0f, 2.4f, 4.1f);
-	trCrate17->scaleVector = glm::vec3(crateScaleFactor * 2, crateScaleFactor * 2, crateScaleFactor * 2);
+	trCrate17->SetTranslation(glm::vec3(19.0f, 2.4f, 4.1f));
+	trCrate17->SetScale(glm::vec3(crateScaleFactor * 2, crateScaleFactor * 2, crateScaleFactor * 2));
 	trCrate17->AddNode(crate);
 
-	trCrate18->translateVector = glm::vec3(19.0f, 2.4f, 5.9f);
-	trCrate18->scaleVector = glm::vec3(crateScaleFactor * 2, crateScaleFactor * 2, crateScaleFactor * 2);
+	trCrate18->SetTranslation(glm::vec3(19.0f, 2.4f, 5.9f));
+	trCrate18->SetScale(glm::vec3(crateScaleFactor * 2, crateScaleFactor * 2, crateScaleFactor * 2));
 	trCrate18->AddNode(crate);
 
-	trCrate19->translateVector = glm::vec3(19.0f, 4.0f, 3.2f);
-	trCrate19->scaleVector = glm::vec3(crateScaleFactor * 2, crateScaleFactor * 2, crateScaleFactor * 2);
+	trCrate19->SetTranslation(glm::vec3(19.0f, 4.0f, 3.2f));
+	trCrate19->SetScale(glm::vec3(crateScaleFactor * 2, crateScaleFactor * 2, crateScaleFactor * 2));
 	trCrate19->AddNode(crate);
 
-	trCrate20->translateVector = glm::vec3(19.0f, 4.0f, 5.0f);
-	trCrate20->scaleVector = glm::vec3(crateScaleFactor * 2, crateScaleFactor * 2, crateScaleFactor * 2);
+	trCrate20->SetTranslation(glm::vec3(19.0f, 4.0f, 5.0f));
+	trCrate20->SetScale(glm::vec3(crateScaleFactor * 2, crateScaleFactor * 2, crateScaleFactor * 2));
 	trCrate20->AddNode(crate);
 
-	trCrate21->translateVector = glm::vec3(19.0f, 5.6f, 3.8f);
-	trCrate21->scaleVector = glm::vec3(crateScaleFactor * 2, crateScaleFactor * 2, crateScaleFactor * 2);
+	trCrate21->SetTranslation(glm::vec3(19.0f, 5.6f, 3.8f));
+	trCrate21->SetScale(glm::vec3(crateScaleFactor * 2, crateScaleFactor * 2, crateScaleFactor * 2));
 	trCrate21->AddNode(crate);
 
 	// place the crates in the scene between the terrain
-	trCrate22->translateVector = glm::vec3(-2.0f, -1.0f, 4.0f);
-	trCrate22->scaleVector = glm::vec3(crateScaleFactor2, crateScaleFactor2, crateScaleFactor2);
+	trCrate22->SetTranslation(glm::vec3(-2.0f, -1.0f, 4.0f));
+	trCrate22->SetScale(glm::vec3(crateScaleFactor2, crateScaleFactor2, crateScaleFactor2));
 	trCrate22->AddNode(crate);
 
-	trCrate23->translateVector = glm::vec3(9.0f, -1.0f, 5.0f);
-	trCrate23->scaleVector = glm::vec3(crateScaleFactor2, crateScaleFactor2, crateScaleFactor2);
+	trCrate23->SetTranslation(glm::vec3(9.0f, -1.0f, 5.0f));
+	trCrate23->SetScale(glm::vec3(crateScaleFactor2, crateScaleFactor2, crateScaleFactor2));
 	trCrate23->AddNode(crate);
 
-	trCrate24->translateVector = glm::vec3(3.0f, -1.0f, 6.0f);
-	trCrate24->scaleVector = glm::vec3(crateScaleFactor2, crateScaleFactor2, crateScaleFactor2);
+	trCrate24->SetTranslation(glm::vec3(3.0f, -1.0f, 6.0f));
+	trCrate24->SetScale(glm::vec3(crateScaleFactor2, crateScaleFactor2, crateScaleFactor2));
 	trCrate24->AddNode(crate);
 
-	trCrate25->translateVector = glm::vec3(-5.0f, -1.0f, 7.0f);
-	trCrate25->scaleVector = glm::vec3(crateScaleFactor2, crateScaleFactor2, crateScaleFactor2);
+	trCrate25->SetTranslation(glm::vec3(-5.0f, -1.0f, 7.0f));
+	trCrate25->SetScale(glm::vec3(crateScaleFactor2, crateScaleFactor2, crateScaleFactor2));
 	trCrate25->AddNode(crate);
 
-	trCrate26->translateVector = glm::vec3(-7.0f, -1.0f, 8.0f);
-	trCrate26->scaleVector = glm::vec3(crateScaleFactor2, crateScaleFactor2, crateScaleFactor2);	
+	trCrate26->SetTranslation(glm::vec3(-7.0f, -1.0f, 8.0f));
+	trCrate26->SetScale(glm::vec3(crateScaleFactor2, crateScaleFactor2, crateScaleFactor2));	
 	trCrate26->AddNode(crate);
 
-	trCrate27->translateVector = glm::vec3(-2.0f, -1.0f, -4.0f);
-	trCrate27->scaleVector = glm::vec3(crateScaleFactor2, crateScaleFactor2, crateScaleFactor2);
+	trCrate27->SetTranslation(glm::vec3(-2.0f, -1.0f, -4.0f));
+	trCrate27->SetScale(glm::vec3(crateScaleFactor2, crateScaleFactor2, crateScaleFactor2));
 	trCrate27->AddNode(crate);
 
-	trCrate28->translateVector = glm::vec3(9.0f, -1.0f, -8.0f);
-	trCrate28->scaleVector = glm::vec3(crateScaleFactor2, crateScaleFactor2, crateScaleFactor2);
+	trCrate28->SetTranslation(glm::vec3(9.0f, -1.0f, -8.0f));
+	trCrate28->SetScale(glm::vec3(crateScaleFactor2, crateScaleFactor2, crateScaleFactor2));
 	trCrate28->AddNode(crate);
 
-	trCrate29->translateVector = glm::vec3(3.0f, -1.0f, -9.0f);
-	trCrate29->scaleVector = glm::vec3(crateScaleFactor2, crateScaleFactor2, crateScaleFactor2);
+	trCrate29->SetTranslation(glm::vec3(3.0f, -1.0f, -9.0f));
+	trCrate29->SetScale(glm::vec3(crateScaleFactor2, crateScaleFactor2, crateScaleFactor2));
 	trCrate29->AddNode(crate);
 
-	trCrate30->translateVector = glm::vec3(-5.0f, -1.0f, -2.0f);
-	trCrate30->scaleVector = glm::vec3(crateScaleFactor2, crateScaleFactor2, crateScaleFactor2);
+	trCrate30->SetTranslation(glm::vec3(-5.0f, -1.0f, -2.0f));
+	trCrate30->SetScale(glm::vec3(crateScaleFactor2, crateScaleFactor2, crateScaleFactor2));
 
 	trCrate30->AddNode(crate);
 
@@ -444,12 +490,20 @@ void Engine::CreateScene()
 
 	//cubeDeb = cube;
 
+	zombies.push_back(zombie);
+
+	// skybox and HUD are pure GL, nothing to create without a context
+	if (Headless::IsEnabled())
+	{
+		skybox = NULL;
+		hudRenderer = NULL;
+		return;
+	}
+
 	// this is skybox node
 
 	skybox = new CubemapNode("./skybox/top.jpg", "./skybox/left.jpg", "./skybox/right.jpg", "./skybox/bottom.jpg", "./skybox/front.jpg", "./skybox/back.jpg");
 	hudRenderer = new HUDRenderer(player);
-
-	zombies.push_back(zombie);
 }
 
 void Engine::Update()
@@ -459,19 +513,41 @@ void Engine::Update()
 	float startTime = SDL_GetTicks() / 1000.0f;
 	int frames = 0;
 
+	Uint64 counterFrequency = SDL_GetPerformanceFrequency();
+	Uint64 lastCounter = SDL_GetPerformanceCounter();
+
+	previousCameraPos = currentCameraPos = renderCameraPos = player->camera->pos;
+
+	int renderedFrames = 0;
+	uint64_t frameAllocations = 0;
+
 	bool quit = false;
 	while (!quit)
 	{
+		Profiler::GetInstance()->BeginFrame();
+		PROFILE_ZONE("Frame");
+
+		uint64_t frameAllocationsStart = AllocationCounter::GetCount();
+
 		float currentFrame = SDL_GetTicks() / 1000.0f;
 		frames++;
 
-		deltaTime = currentFrame - lastFrame;
-		lastFrame = currentFrame;
+		Uint64 counter = SDL_GetPerformanceCounter();
+		float frameTime = (float)(counter - lastCounter) / counterFrequency;
+		lastCounter = counter;
+
+		if (frameTime > MaxFrameTime)
+			frameTime = MaxFrameTime;
 
 #ifdef FPS_COUNT
 		if (currentFrame - startTime >= 1.0)
 		{
-			printf("%f ms/frame\n", 1000.0f / float(frames));
+			printf("%f ms/frame, %llu heap allocations/frame\n", 1000.0f / float(frames), (unsigned long long)(frameAllocations / frames));
+			const RenderQueue::Stats& rq = RenderQueue::GetInstance()->GetStats();
+			printf("%d draws (%d instanced, %d instances), %d shader binds, %d material binds, %d VAO binds\n", rq.draws, rq.instancedDraws, rq.instances, rq.shaderBinds, rq.materialBinds, rq.vaoBinds);
+			const OcclusionCuller::Stats& oc = OcclusionCuller::GetInstance()->GetStats();
+			printf("occlusion: %d nodes tested, %d occluded, %d draws culled, %d queries\n", oc.tested, oc.occludedNodes, oc.culledDraws, oc.queriesIssued);
+			frameAllocations = 0;
 			frames = 0;
 			startTime += 1.0f;
 		}
@@ -498,28 +574,109 @@ void Engine::Update()
 
 		int count;
 
+		// the action vector holds the keys held this frame and is applied to every tick run this frame
+		actionVector = glm::vec3(0.0f);
 		const Uint8* keystates = SDL_GetKeyboardState(&count);
 		HandleKeyDown(keystates);
 
-		UpdateActions(); 
+		// run as many fixed ticks as the elapsed time allows, the remainder carries over to the next frame
+		accumulator += frameTime;
+		while (accumulator >= deltaTime)
+		{
+			SaveState();
+			UpdateActions();
+			currentCameraPos = player->camera->pos;
+
+			accumulator -= deltaTime;
+		}
+
+		InterpolateState(accumulator / deltaTime);
+
+		// models imported in the background get their GL objects here, a bounded slice of every frame until the level is in
+		AssetLoader::GetInstance()->Update(AssetUploadBudgetMs);
+
+		// the steady-state render loop must not touch the heap, report every frame that does
+		uint64_t allocationsBefore = AllocationCounter::GetCount();
 
 		Render();
 
+		uint64_t renderAllocations = AllocationCounter::GetCount() - allocationsBefore;
+		if (renderAllocations > 0 && renderedFrames >= AllocationWarmupFrames)
+		{
+			printf("Warning: Render performed %llu heap allocations in frame %d\n", (unsigned long long)renderAllocations, renderedFrames);
+		}
+		renderedFrames++;
+
 		SDL_GL_SwapWindow(gWindow);
+
+		frameAllocations += AllocationCounter::GetCount() - frameAllocationsStart;
 	}
 
+	Profiler::GetInstance()->ExportChromeTrace("./profile_trace.json");
+
+	// the window was closed, don't leave the import workers parked behind main
+	AssetLoader::GetInstance()->Shutdown();
+
 	// close();
 }
 
+// remember the state before a tick so rendering can blend towards the state after it
+void Engine::SaveState()
+{
+	previousCameraPos = player->camera->pos;
+
+	for (auto it = zombies.begin(); it != zombies.end(); ++it)
+	{
+		(*it)->SavePreviousState();
+	}
+}
+
+// blend the last two simulation states for rendering, alpha is how far the render time is past the last tick
+void Engine::InterpolateState(float alpha)
+{
+	renderCameraPos = glm::mix(previousCameraPos, currentCameraPos, alpha);
+
+	for (auto it = zombies.begin(); it != zombies.end(); ++it)
+	{
+		(*it)->Interpolate(alpha);
+	}
+}
+
+void Engine::UpdateHeadless(int ticks)
+{
+	// fixed tick, no events and no rendering, just the simulation
+
+	auto start = std::chrono::steady_clock::now();
+
+	for (int tick = 0; tick < ticks; tick++)
+	{
+		Profiler::GetInstance()->BeginFrame();
+		UpdateActions();
+	}
+
+	auto end = std::chrono::steady_clock::now();
+	float elapsedMs = std::chrono::duration<float, std::milli>(end - start).count();
+
+	printf("Headless: %d ticks (%.1f s simulated) in %.2f ms, player health %d\n", ticks, ticks * deltaTime, elapsedMs, player->GetHealth());
+	for (size_t i = 0; i < zombies.size(); i++)
+	{
+		printf("Headless: zombie %d health %d\n", (int)i, zombies[i]->GetHealth());
+	}
+
+	Profiler::GetInstance()->ExportChromeTrace("./profile_trace.json");
+}
+
 void Engine::Render()
 {
+	PROFILE_ZONE("Render");
+	PROFILE_GPU_ZONE("Render");
+
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-	glm::mat4 view = player->camera->GetViewMatrix();
+	glm::mat4 view = player->camera->GetViewMatrix(renderCameraPos);
 	glm::mat4 proj = player->camera->GetProjectionMatrix();
 
-	ShaderLibrary::GetInstance()->SetPVGlobal(proj, view);
-	ShaderLibrary::GetInstance()->SetGlobalLight(glm::vec3(-100.0f, 100.0f, 0.0f), glm::vec3(1.0f, 1.0f, 1.0f), player->camera->pos);
+	ShaderLibrary::GetInstance()->SetFrameData(proj, view, glm::vec3(-100.0f, 100.0f, 0.0f), glm::vec3(1.0f, 1.0f, 1.0f), renderCameraPos, SDL_GetTicks() / 1000.0f);
 	//Shader* objectShader = ShaderLibrary::GetInstance()->GetShader("object_shader");
 	//cout<<objectShader->ID<<endl;
 	//objectShader->use();
@@ -527,10 +684,45 @@ void Engine::Render()
 	//objectShader->setFloat("fogStart", 10.0f);
 	//objectShader->setFloat("fogEnd", 50.0f);
 
-	skybox->Visualize();
-	SceneGraph->Visualize(glm::mat4(1.0f));
-	bulletEngine->Visualize();
-	hudRenderer->Visualize();
+	{
+		PROFILE_ZONE("Skybox");
+		PROFILE_GPU_ZONE("Skybox");
+		skybox->Visualize();
+	}
+	{
+		PROFILE_ZONE("SceneGraph::Visualize");
+		PROFILE_GPU_ZONE("SceneGraph::Visualize");
+		// world matrices of everything that moved since the last tick or frame (interpolated zombies)
+		TransformHierarchy::GetInstance()->Update(SceneGraph);
+		// the tick-time bounds of the BVH refit can miss a zombie drawn up to one tick behind, cull against the drawn pose
+		SceneGraph->TraverseBounds(glm::mat4(1.0f), NULL);
+
+		// groups and models outside the view are skipped during the traversal
+		cullingFrustum.Extract(proj * view);
+		SceneNode::SetCullingFrustum(&cullingFrustum);
+		// distant models are drawn with their simplified meshes
+		SceneNode::SetLodView(renderCameraPos, proj[1][1]);
+
+		// subtrees whose bounds were hidden in an earlier frame are skipped as well
+		OcclusionCuller::GetInstance()->Begin(renderCameraPos, proj, view);
+
+		// the traversal only queues draws, they are issued sorted by state on Flush
+		RenderQueue::GetInstance()->Begin(renderCameraPos);
+		SceneGraph->Visualize(glm::mat4(1.0f));
+		RenderQueue::GetInstance()->Flush();
+
+		// test the bounds against the finished depth buffer, the results decide what is skipped next frame
+		OcclusionCuller::GetInstance()->IssueQueries();
+	}
+	{
+		PROFILE_ZONE("BulletEngine::Visualize");
+		PROFILE_GPU_ZONE("BulletEngine::Visualize");
+		bulletEngine->Visualize();
+	}
+	{
+		PROFILE_GPU_ZONE("HUDRenderer::Visualize");
+		hudRenderer->Visualize();
+	}
 }
 
 void Engine::HandleKeyDown(const Uint8* keystates)
@@ -568,6 +760,8 @@ void Engine::HandleKeyDown(const Uint8* keystates)
 
 void Engine::UpdateActions()
 {
+	PROFILE_ZONE("UpdateActions");
+
 	if (firstStart)
 	{
 
@@ -579,8 +773,6 @@ void Engine::UpdateActions()
 	if (actionVector.y == 1.0f)
 		player->Jump();
 
-	actionVector = glm::vec3(0.0f);
-
 	player->UpdateGravity(deltaTime); 
 	for (auto it = zombies.begin(); it != zombies.end(); ++it)
 	{
@@ -620,6 +812,10 @@ void Engine::HandleMouseClick(const SDL_MouseButtonEvent& button)
 
 void Engine::Close()
 {
+	Profiler::GetInstance()->ExportChromeTrace("./profile_trace.json");
+
+	AssetLoader::GetInstance()->Shutdown();
+
 	// close the window
 	ShaderLibrary::GetInstance()->UnloadShaders();
 	// close program..
@@ -21,11 +21,36 @@ public:
 	Engine(Player* pl);
 
 	void Start();
+
+	// run the simulation without window or GL for the given number of ticks
+	void StartHeadless(int ticks, float tickRate);
+
+	// simulation ticks per second, independent from the render rate, invalid rates fall back to DefaultSimulationRate
+	void SetSimulationRate(float hz);
+
+	static constexpr float DefaultSimulationRate = 60.0f;
 private:
 	SDL_Window* gWindow;
 
-	float deltaTime = 0.0f;
-	float lastFrame = 0.0f;
+	// fixed simulation step, UpdateActions always advances by exactly this much
+	float deltaTime = 1.0f / DefaultSimulationRate;
+	float accumulator = 0.0f;
+	// cap on the frame time fed to the accumulator so a long stall doesn't spiral into ever more ticks
+	const float MaxFrameTime = 0.25f;
+
+	// camera position before and after the last simulation tick, rendered interpolated between them
+	glm::vec3 previousCameraPos;
+	glm::vec3 currentCameraPos;
+	glm::vec3 renderCameraPos;
+
+	// frames rendered before the render loop is expected to stop allocating (shader caches, GL driver warm-up)
+	const int AllocationWarmupFrames = 120;
+
+	// time per frame spent turning background imports into GL objects while the level streams in
+	const float AssetUploadBudgetMs = 2.0f;
+
+	// view frustum of the frame being rendered, the scene graph culls against it
+	Frustum cullingFrustum;
 
 	glm::vec3 actionVector = glm::vec3(0.0f);
 
@@ -44,6 +69,9 @@ private:
 
 	bool Init();
 	bool InitGL();
+	bool InitHeadless();
+
+	void UpdateHeadless(int ticks);
 
 	bool firstStart = true;
 
@@ -56,6 +84,8 @@ private:
 	void HandleMouseClick(const SDL_MouseButtonEvent& button);
 
 	void Render();
+	void SaveState();
+	void InterpolateState(float alpha);
 
 	// DEBUG
 	//Shader cubeShader;
@@ -1,5 +1,6 @@
 #include "HUDRenderer.h"
 #include "ShaderLibrary.h"
+#include "Profiler.h"
 
 /* HUDRenderer stands for Heads - Up Display Renderer and it is responsible for rendering the HUD of the game.*/
 
@@ -151,6 +152,8 @@ void HUDRenderer::CreateAmmo()
 
 void HUDRenderer::Visualize()
 {
+	PROFILE_ZONE("HUDRenderer::Visualize");
+
 	glDisable(GL_DEPTH_TEST);
 	glEnable(GL_BLEND);
 
@@ -191,12 +194,12 @@ void HUDRenderer::Visualize()
 void HUDRenderer::VisualizeCrosshair()
 {
 	shd->use();
-	shd->setMat4("ortho", orthoMat);
-	shd->setFloat("render_offset", 0.0f);
+	shd->setMat4(Shader::UNIFORM_ORTHO, orthoMat);
+	shd->setFloat(Shader::UNIFORM_RENDER_OFFSET, 0.0f);
 
 	glActiveTexture(GL_TEXTURE0);
 
-	glUniform1i(glGetUniformLocation(shd->ID, "text_diffuse"), 0);
+	shd->setInt(Shader::UNIFORM_TEXT_DIFFUSE, 0);
 	glBindTexture(GL_TEXTURE_2D, texID_cross);
 
 	glBindVertexArray(VAO_cross);
@@ -210,11 +213,11 @@ void HUDRenderer::VisualizeCrosshair()
 void HUDRenderer::VisualizeHealth(bool isFilled, float offset)
 {
 	shd->use();
-	shd->setMat4("ortho", orthoMat);
-	shd->setFloat("render_offset", offset);
+	shd->setMat4(Shader::UNIFORM_ORTHO, orthoMat);
+	shd->setFloat(Shader::UNIFORM_RENDER_OFFSET, offset);
 
 	glActiveTexture(GL_TEXTURE0);
-	glUniform1i(glGetUniformLocation(shd->ID, "text_diffuse"), 0);
+	shd->setInt(Shader::UNIFORM_TEXT_DIFFUSE, 0);
 	if (isFilled)
 	{ // use filled heart texture
 		glBindTexture(GL_TEXTURE_2D, texID_heart_f);
@@ -235,11 +238,11 @@ void HUDRenderer::VisualizeHealth(bool isFilled, float offset)
 void HUDRenderer::VisualizeAmmo(bool isFilled, float offset)
 {
 	shd->use();
-	shd->setMat4("ortho", orthoMat);
-	shd->setFloat("render_offset", offset);
+	shd->setMat4(Shader::UNIFORM_ORTHO, orthoMat);
+	shd->setFloat(Shader::UNIFORM_RENDER_OFFSET, offset);
 
 	glActiveTexture(GL_TEXTURE0);
-	glUniform1i(glGetUniformLocation(shd->ID, "text_diffuse"), 0);
+	shd->setInt(Shader::UNIFORM_TEXT_DIFFUSE, 0);
 	if (isFilled)
 	{
 		glBindTexture(GL_TEXTURE_2D, texID_ammo_f);
@@ -0,0 +1,13 @@
+#include "Headless.h"
+
+bool Headless::enabled = false;
+
+bool Headless::IsEnabled()
+{
+	return enabled;
+}
+
+void Headless::Enable()
+{
+	enabled = true;
+}
@@ -0,0 +1,16 @@
+#pragma once
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+// global switch for running the simulation without a window or GL context
+// when enabled, every class that would otherwise touch GL (Mesh, Model textures) skips the GPU side and keeps only the CPU data
+class Headless
+{
+public:
+	static bool IsEnabled();
+	static void Enable();
+private:
+	static bool enabled;
+};
+
+#endif
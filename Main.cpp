@@ -1,16 +1,57 @@
 #include "Camera.h"
 #include "Player.h"
 #include "Engine.h"
+#include "RayKernels.h"
+#include "BakedMesh.h"
+#include "BakedTexture.h"
+#include <string.h>
+#include <stdlib.h>
 
 
 int main(int argc, char* argv[])
 {
+	// --bench-rays times the batched ray kernels against the per object bounding volume tests and exits
+	if (argc > 1 && strcmp(argv[1], "--bench-rays") == 0)
+	{
+		RayKernels::RunBenchmark();
+		return 0;
+	}
+
+	// --bake [files...] writes the binary .bmesh of the given models, or of everything below ./models, and exits
+	if (argc > 1 && strcmp(argv[1], "--bake") == 0)
+	{
+		std::vector<std::string> paths(argv + 2, argv + argc);
+		return BakedMesh::BakeAll(paths) == 0 ? 0 : 1;
+	}
+
+	// --bake-textures [files...] writes the block compressed .ktx of the given images, or of every image below ./models, and exits
+	if (argc > 1 && strcmp(argv[1], "--bake-textures") == 0)
+	{
+		std::vector<std::string> paths(argv + 2, argv + argc);
+		return BakedTexture::BakeAll(paths) == 0 ? 0 : 1;
+	}
 	
 	Camera* cam = new Camera();
 	
 	Player* player = new Player(cam);
 	Engine* engine = new Engine(player);
 
+	// --headless [ticks] [tickRate] runs the simulation without a window, e.g. for balancing and soak tests
+	if (argc > 1 && strcmp(argv[1], "--headless") == 0)
+	{
+		int ticks = argc > 2 ? atoi(argv[2]) : 60 * 60 * 5;
+		// checked by SetSimulationRate, which falls back to the default rate
+		float tickRate = argc > 3 ? (float)atof(argv[3]) : Engine::DefaultSimulationRate;
+		engine->StartHeadless(ticks, tickRate);
+		return 0;
+	}
+
+	// --sim-rate <hz> changes the fixed simulation tick rate, rendering still runs as fast as vsync allows
+	if (argc > 2 && strcmp(argv[1], "--sim-rate") == 0)
+	{
+		engine->SetSimulationRate((float)atof(argv[2]));
+	}
+
 	engine->Start();
 
 	return 0;
@@ -0,0 +1,37 @@
+#pragma once
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <string>
+#include <stddef.h>
+
+// read only memory mapping of a whole file (MapViewOfFile on Windows, mmap elsewhere)
+// the pages are read in by the OS on first touch, nothing is copied into the process until the data is used
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	bool Open(const std::string& path);
+	void Close();
+
+	const unsigned char* GetData() const;
+	size_t GetSize() const;
+private:
+	const unsigned char* data;
+	size_t size;
+
+#ifdef _WIN32
+	void* file;
+	void* mapping;
+#else
+	int fd;
+#endif
+
+	// not copyable, the mapping is released once
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+};
+
+#endif
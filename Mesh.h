@@ -7,16 +7,24 @@
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/packing.hpp>
 
 #include "shader.h"
+#include "Headless.h"
+#include "MeshBVH.h"
 
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <vector>
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+#include <stdint.h>
 using namespace std;
 
+// full precision vertex kept on the CPU side (BVH, bounds, baking), the GPU gets the compact layout picked by Mesh::setupMesh
 struct Vertex {
 	// position
 	glm::vec3 Position;
@@ -43,75 +51,265 @@ public:
 	vector<unsigned int> indices;
 	vector<Texture> textures;
 	unsigned int VAO;
+	// triangle BVH for exact ray hits, built at load time
+	MeshBVH bvh;
+
+	// levels of detail 0 (indices) and up to MaxLods - 1 simplified ones (see MeshSimplifier)
+	// the simplified levels share the vertices, their indices follow the full resolution ones in lodIndices and the EBO
+	struct Lod
+	{
+		unsigned int firstIndex;	// into lodIndices
+		unsigned int indexCount;
+	};
+	static const int MaxLods = 4;
+	vector<Lod> lods;				// levels 1..
+	vector<unsigned int> lodIndices;
 
 	/*  Functions  */
-	// constructor
-	Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+	// constructor, upload = false keeps the mesh CPU only (asset loader worker threads) until Upload is called on the GL thread
+	Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, bool upload = true)
 	{
-		this->vertices = vertices;
-		this->indices = indices;
-		this->textures = textures;
+		this->vertices = std::move(vertices);
+		this->indices = std::move(indices);
+		this->textures = std::move(textures);
+		VAO = VBO = EBO = 0;
+
+		setupSamplers();
+
+		bvh.Build(this->vertices, this->indices);
+
+		if (upload)
+			Upload();
+	}
 
-		// now that we have all the required data, set the vertex buffers and its attribute pointers.
-		setupMesh();
+	// now that we have all the required data, set the vertex buffers and its attribute pointers.
+	// headless runs keep only the CPU side data (used for bounds)
+	void Upload()
+	{
+		if (!Headless::IsEnabled())
+			setupMesh();
 	}
 
 	// render the mesh
-	void Draw(Shader shader)
+	void Draw(const Shader& shader) const
 	{
-		// bind appropriate textures
-		unsigned int diffuseNr = 1;
-		unsigned int specularNr = 1;
-		unsigned int normalNr = 1;
-		unsigned int heightNr = 1;
+		shader.use();
+
+		BindMaterial(shader);
+		DrawGeometry();
 
-		bool specularSet = false;
+		glBindVertexArray(0);
+		// always good practice to set everything back to defaults once configured.
+		glActiveTexture(GL_TEXTURE0);
+	}
 
+	// binds the textures and sets the material uniforms, the shader must be in use
+	void BindMaterial(const Shader& shader) const
+	{
+		// bind appropriate textures, the sampler uniforms were resolved in the constructor
 		for (unsigned int i = 0; i < textures.size(); i++)
 		{
 			glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
-											  // retrieve texture number (the N in diffuse_textureN)
-			string number;
-			string name = "material." + textures[i].type;
-			if (name == "material.texture_diffuse")
-				number = std::to_string(diffuseNr++);
-			else if (name == "material.texture_specular")
-			{
-				number = std::to_string(specularNr++); // transfer unsigned int to stream
-				specularSet = true;
-			}
-			else if (name == "material.texture_normal")
-				number = std::to_string(normalNr++); // transfer unsigned int to stream
-			else if (name == "material.texture_height")
-				number = std::to_string(heightNr++); // transfer unsigned int to stream
-
-													 // now set the sampler to the correct texture unit
-			glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
+			// now set the sampler to the correct texture unit
+			if (samplerUniforms[i] >= 0)
+				shader.setInt((Shader::UniformId)samplerUniforms[i], i);
 			// and finally bind the texture
 			glBindTexture(GL_TEXTURE_2D, textures[i].id);
 		}
 
-		shader.use();
-		shader.setFloat("material.shininess", 64.0f);
-		shader.setBool("material.specularSet", specularSet);
+		shader.setFloat(Shader::UNIFORM_MATERIAL_SHININESS, 64.0f);
+		shader.setBool(Shader::UNIFORM_MATERIAL_SPECULAR_SET, specularSet);
+	}
 
-		// draw mesh
+	// binds the VAO and issues the draw call, leaves the VAO bound so consecutive draws of the same mesh can skip the bind
+	void DrawGeometry(int lod = 0) const
+	{
 		glBindVertexArray(VAO);
-		glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-		glBindVertexArray(0);
+		glDrawElements(GL_TRIANGLES, GetIndexCount(lod), indexType, GetIndexOffset(lod));
+	}
 
-		// always good practice to set everything back to defaults once configured.
-		glActiveTexture(GL_TEXTURE0);
+	// replaces the simplified levels, before Upload
+	void SetLods(const vector<vector<unsigned int>>& levels)
+	{
+		lods.clear();
+		lodIndices.clear();
+		for (unsigned int l = 0; l < levels.size() && l + 1 < (unsigned int)MaxLods; l++)
+		{
+			Lod lod = { (unsigned int)lodIndices.size(), (unsigned int)levels[l].size() };
+			lodIndices.insert(lodIndices.end(), levels[l].begin(), levels[l].end());
+			lods.push_back(lod);
+		}
+	}
+
+	int GetLodCount() const
+	{
+		return 1 + (int)lods.size();
+	}
+
+	// levels the mesh doesn't have fall back to its coarsest one
+	GLsizei GetIndexCount(int lod) const
+	{
+		if (lod <= 0 || lods.empty())
+			return (GLsizei)indices.size();
+		return (GLsizei)lods[std::min(lod, (int)lods.size()) - 1].indexCount;
+	}
+
+	// byte offset of the level in the EBO, passed as the indices pointer of the draw
+	const void* GetIndexOffset(int lod) const
+	{
+		if (lod <= 0 || lods.empty())
+			return (const void*)0;
+		size_t first = indices.size() + lods[std::min(lod, (int)lods.size()) - 1].firstIndex;
+		return (const void*)(first * (indexType == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int)));
+	}
+
+	// type of the indices in the EBO, GL_UNSIGNED_SHORT whenever the vertex count allows it
+	GLenum GetIndexType() const
+	{
+		return indexType;
+	}
+
+	// true if BindMaterial of both meshes would leave the same textures and material uniforms behind
+	bool SameMaterial(const Mesh& other) const
+	{
+		if (textures.size() != other.textures.size() || specularSet != other.specularSet)
+			return false;
+
+		for (unsigned int i = 0; i < textures.size(); i++)
+		{
+			if (textures[i].id != other.textures[i].id || samplerUniforms[i] != other.samplerUniforms[i])
+				return false;
+		}
+		return true;
 	}
 
 private:
 	/*  Render data  */
 	unsigned int VBO, EBO;
 
+	// GPU vertex layout, picked per mesh by setupMesh from what the mesh actually uses:
+	//	position	3 x float
+	//	normal		GL_INT_2_10_10_10_REV, normalized
+	//	texCoords	2 x half float when every coordinate fits without losing a texel, 2 x float otherwise
+	//	tangent		GL_INT_2_10_10_10_REV, w holds the handedness
+	// the bitangent is not uploaded, a normal mapping vertex shader rebuilds it as cross(aNormal, aTangent.xyz) * aTangent.w
+	// the tangent is only stored for meshes with a normal map, attribute 3 stays disabled otherwise (attribute 4 is unused)
+	// which makes a vertex 20 bytes (terrain, bullets, most props) or 24 bytes instead of the 56 of Vertex
+	bool normalMapped;
+	bool halfTexCoords;
+	GLenum indexType = GL_UNSIGNED_INT;
+
+	// half floats have 10 mantissa bits, up to 2.0 a coordinate is still exact to a texel of a 1024 texture
+	static constexpr float MaxHalfTexCoord = 2.0f;
+
+	// material.texture_<type>N uniform of every texture (Shader::UniformId, -1 if the type is unknown)
+	vector<int> samplerUniforms;
+	bool specularSet;
+
 	/*  Functions    */
+	// resolves which material sampler every texture binds to, done once instead of building "material." + type + N strings per draw
+	void setupSamplers()
+	{
+		int diffuseNr = 0;
+		int specularNr = 0;
+		int normalNr = 0;
+		int heightNr = 0;
+
+		specularSet = false;
+		normalMapped = false;
+		samplerUniforms.resize(textures.size());
+
+		for (unsigned int i = 0; i < textures.size(); i++)
+		{
+			const string& type = textures[i].type;
+			int base = -1;
+			int number = 0;
+			if (type == "texture_diffuse")
+			{
+				base = Shader::UNIFORM_TEXTURE_DIFFUSE;
+				number = diffuseNr++;
+			}
+			else if (type == "texture_specular")
+			{
+				base = Shader::UNIFORM_TEXTURE_SPECULAR;
+				number = specularNr++;
+				specularSet = true;
+			}
+			else if (type == "texture_normal")
+			{
+				base = Shader::UNIFORM_TEXTURE_NORMAL;
+				number = normalNr++;
+				normalMapped = true;
+			}
+			else if (type == "texture_height")
+			{
+				base = Shader::UNIFORM_TEXTURE_HEIGHT;
+				number = heightNr++;
+			}
+
+			if (base >= 0 && number < Shader::MaxMaterialTextures)
+				samplerUniforms[i] = base + number;
+			else
+				samplerUniforms[i] = -1;
+		}
+	}
+
+	// signed normalized 10-10-10-2, x in the low bits as GL_INT_2_10_10_10_REV expects
+	static GLuint packSnorm1010102(const glm::vec3& v, float w)
+	{
+		glm::vec3 c = glm::clamp(v, -1.0f, 1.0f) * 511.0f;
+		int x = (int)roundf(c.x);
+		int y = (int)roundf(c.y);
+		int z = (int)roundf(c.z);
+		int iw = w < 0.0f ? -1 : 1;
+		return (GLuint)(x & 0x3FF) | ((GLuint)(y & 0x3FF) << 10) | ((GLuint)(z & 0x3FF) << 20) | ((GLuint)(iw & 0x3) << 30);
+	}
+
 	// initializes all the buffer objects/arrays
 	void setupMesh()
 	{
+		halfTexCoords = true;
+		for (unsigned int i = 0; i < vertices.size() && halfTexCoords; i++)
+		{
+			if (fabsf(vertices[i].TexCoords.x) > MaxHalfTexCoord || fabsf(vertices[i].TexCoords.y) > MaxHalfTexCoord)
+				halfTexCoords = false;
+		}
+
+		const unsigned int normalOffset = sizeof(glm::vec3);
+		const unsigned int texCoordsOffset = normalOffset + sizeof(GLuint);
+		const unsigned int tangentOffset = texCoordsOffset + (halfTexCoords ? sizeof(GLuint) : sizeof(glm::vec2));
+		const unsigned int vertexStride = normalMapped ? tangentOffset + sizeof(GLuint) : tangentOffset;
+
+		// pack the vertices into the layout, the float copy stays for the CPU side users
+		vector<unsigned char> packed(vertices.size() * vertexStride);
+		for (unsigned int i = 0; i < vertices.size(); i++)
+		{
+			const Vertex& v = vertices[i];
+			unsigned char* dst = &packed[i * vertexStride];
+
+			memcpy(dst, &v.Position, sizeof(glm::vec3));
+
+			GLuint normal = packSnorm1010102(v.Normal, 1.0f);
+			memcpy(dst + normalOffset, &normal, sizeof(GLuint));
+
+			if (halfTexCoords)
+			{
+				GLuint texCoords = glm::packHalf2x16(v.TexCoords);
+				memcpy(dst + texCoordsOffset, &texCoords, sizeof(GLuint));
+			}
+			else
+			{
+				memcpy(dst + texCoordsOffset, &v.TexCoords, sizeof(glm::vec2));
+			}
+
+			if (normalMapped)
+			{
+				float handedness = glm::dot(glm::cross(v.Normal, v.Tangent), v.Bitangent) < 0.0f ? -1.0f : 1.0f;
+				GLuint tangent = packSnorm1010102(v.Tangent, handedness);
+				memcpy(dst + tangentOffset, &tangent, sizeof(GLuint));
+			}
+		}
+
 		// create buffers/arrays
 		glGenVertexArrays(1, &VAO);
 		glGenBuffers(1, &VBO);
@@ -120,30 +318,43 @@ private:
 		glBindVertexArray(VAO);
 		// load data into vertex buffers
 		glBindBuffer(GL_ARRAY_BUFFER, VBO);
-		// A great thing about structs is that their memory layout is sequential for all its items.
-		// The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
-		// again translates to 3/2 floats which translates to a byte array.
-		glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+		glBufferData(GL_ARRAY_BUFFER, packed.size(), packed.data(), GL_STATIC_DRAW);
 
+		// all levels of detail in one EBO, the full resolution first
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+		if (vertices.size() <= 0x10000)
+		{
+			// the CPU side keeps 32 bit indices for the BVH and the baker
+			vector<unsigned short> shortIndices(indices.begin(), indices.end());
+			shortIndices.insert(shortIndices.end(), lodIndices.begin(), lodIndices.end());
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, shortIndices.size() * sizeof(unsigned short), shortIndices.data(), GL_STATIC_DRAW);
+			indexType = GL_UNSIGNED_SHORT;
+		}
+		else
+		{
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, (indices.size() + lodIndices.size()) * sizeof(unsigned int), NULL, GL_STATIC_DRAW);
+			glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, indices.size() * sizeof(unsigned int), indices.data());
+			if (!lodIndices.empty())
+				glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), lodIndices.size() * sizeof(unsigned int), lodIndices.data());
+			indexType = GL_UNSIGNED_INT;
+		}
 
-		// set the vertex attribute pointers
+		// set the vertex attribute pointers, the normalized formats reach the shaders as plain floats
 		// vertex Positions
 		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, vertexStride, (void*)0);
 		// vertex normals
 		glEnableVertexAttribArray(1);
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+		glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, vertexStride, (void*)(uintptr_t)normalOffset);
 		// vertex texture coords
 		glEnableVertexAttribArray(2);
-		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-		// vertex tangent
-		glEnableVertexAttribArray(3);
-		glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
-		// vertex bitangent
-		glEnableVertexAttribArray(4);
-		glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+		glVertexAttribPointer(2, 2, halfTexCoords ? GL_HALF_FLOAT : GL_FLOAT, GL_FALSE, vertexStride, (void*)(uintptr_t)texCoordsOffset);
+		if (normalMapped)
+		{
+			// vertex tangent and handedness, the shader derives the bitangent from them
+			glEnableVertexAttribArray(3);
+			glVertexAttribPointer(3, 4, GL_INT_2_10_10_10_REV, GL_TRUE, vertexStride, (void*)(uintptr_t)tangentOffset);
+		}
 
 		glBindVertexArray(0);
 	}
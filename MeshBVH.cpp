@@ -0,0 +1,89 @@
+#include "MeshBVH.h"
+#include "Mesh.h"
+#include "RayKernels.h"
+#include <float.h>
+#include <algorithm>
+
+bool MeshBVH::IsBuilt() const
+{
+	return tree.IsBuilt();
+}
+
+int MeshBVH::GetTriangleCount() const
+{
+	return (int)tree.primIndices.size();
+}
+
+void MeshBVH::TriangleBounds::GetBounds(int prim, glm::vec3& bMin, glm::vec3& bMax) const
+{
+	bMin = triMin[prim];
+	bMax = triMax[prim];
+}
+
+glm::vec3 MeshBVH::TriangleBounds::GetCentroid(int prim) const
+{
+	return triCentroid[prim];
+}
+
+void MeshBVH::Build(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices)
+{
+	int triCount = (int)(indices.size() / 3);
+
+	TriangleBounds bounds;
+	bounds.triMin.resize(triCount);
+	bounds.triMax.resize(triCount);
+	bounds.triCentroid.resize(triCount);
+
+	for (int i = 0; i < triCount; i++)
+	{
+		const glm::vec3& a = vertices[indices[i * 3]].Position;
+		const glm::vec3& b = vertices[indices[i * 3 + 1]].Position;
+		const glm::vec3& c = vertices[indices[i * 3 + 2]].Position;
+
+		bounds.triMin[i] = glm::min(glm::min(a, b), c);
+		bounds.triMax[i] = glm::max(glm::max(a, b), c);
+		bounds.triCentroid[i] = (a + b + c) / 3.0f;
+	}
+
+	// large leaves cost a scalar pass per 4 triangles, still split them unless the split is clearly worse
+	tree.Build(triCount, bounds, MaxLeafSize, MaxLeafSize * 4);
+
+	// leaf order triangle data for the ray kernel
+	v0x.resize(triCount); v0y.resize(triCount); v0z.resize(triCount);
+	e1x.resize(triCount); e1y.resize(triCount); e1z.resize(triCount);
+	e2x.resize(triCount); e2y.resize(triCount); e2z.resize(triCount);
+
+	for (int i = 0; i < triCount; i++)
+	{
+		int tri = tree.primIndices[i];
+		const glm::vec3& a = vertices[indices[tri * 3]].Position;
+		glm::vec3 e1 = vertices[indices[tri * 3 + 1]].Position - a;
+		glm::vec3 e2 = vertices[indices[tri * 3 + 2]].Position - a;
+
+		v0x[i] = a.x; v0y[i] = a.y; v0z[i] = a.z;
+		e1x[i] = e1.x; e1y[i] = e1.y; e1z[i] = e1.z;
+		e2x[i] = e2.x; e2y[i] = e2.y; e2z[i] = e2.z;
+	}
+}
+
+int MeshBVH::Raycast(const glm::vec3& orig, const glm::vec3& dir, float tMax, float& t) const
+{
+	float bestT = tMax;
+	int bestTri = -1;
+
+	tree.Traverse(orig, dir, bestT, [&](int first, int count, float& tBest)
+	{
+		float tHit;
+		int k = RayKernels::RayTriangles(orig, dir, &v0x[first], &v0y[first], &v0z[first], &e1x[first], &e1y[first], &e1z[first],
+			&e2x[first], &e2y[first], &e2z[first], count, tBest, tHit);
+		if (k >= 0)
+		{
+			tBest = tHit;
+			bestTri = tree.primIndices[first + k];
+		}
+	});
+
+	if (bestTri >= 0)
+		t = bestT;
+	return bestTri;
+}
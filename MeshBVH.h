@@ -0,0 +1,48 @@
+#pragma once
+#ifndef MESHBVH_H
+#define MESHBVH_H
+
+#include <glm/glm.hpp>
+#include <vector>
+#include "BVHTree.h"
+
+struct Vertex;
+
+// bottom level BVH over the triangles of one mesh, in the mesh's local space
+// built once at load time with the same binned SAH as SceneBVH, the triangles are stored per leaf as v0/e1/e2 component
+// arrays so a leaf is tested with one RayKernels::RayTriangles call
+class MeshBVH
+{
+public:
+	void Build(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices);
+
+	// closest triangle hit with t < tMax in local space, returns the triangle index (into indices / 3) or -1
+	int Raycast(const glm::vec3& orig, const glm::vec3& dir, float tMax, float& t) const;
+
+	bool IsBuilt() const;
+	int GetTriangleCount() const;
+private:
+	// BVHTree bounds policy, per triangle bounds and centroid, only alive while building
+	struct TriangleBounds
+	{
+		std::vector<glm::vec3> triMin;
+		std::vector<glm::vec3> triMax;
+		std::vector<glm::vec3> triCentroid;
+
+		void GetBounds(int prim, glm::vec3& bMin, glm::vec3& bMax) const;
+		glm::vec3 GetCentroid(int prim) const;
+	};
+
+	static const int MaxLeafSize = 4;
+	static const int SahBins = 8;
+
+	// leaf slots map to the original triangles through tree.primIndices
+	BVHTree<SahBins> tree;
+
+	// triangles in leaf order
+	std::vector<float> v0x, v0y, v0z;
+	std::vector<float> e1x, e1y, e1z;
+	std::vector<float> e2x, e2y, e2z;
+};
+
+#endif
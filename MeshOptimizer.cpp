@@ -0,0 +1,249 @@
+#include "MeshOptimizer.h"
+#include "Mesh.h"
+#include <stdio.h>
+#include <algorithm>
+
+bool MeshOptimizer::reportStats = false;
+
+void MeshOptimizer::SetReportStats(bool report)
+{
+	reportStats = report;
+}
+
+void MeshOptimizer::Optimize(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices)
+{
+	if (indices.size() < 3 || vertices.empty())
+		return;
+
+	CacheStats before = AnalyzeVertexCache(indices, (unsigned int)vertices.size());
+
+	std::vector<unsigned int> clusters;
+	OptimizeVertexCache(indices, (unsigned int)vertices.size(), &clusters);
+	OptimizeOverdraw(vertices, indices, clusters);
+	OptimizeVertexFetch(vertices, indices);
+
+	if (reportStats)
+	{
+		CacheStats after = AnalyzeVertexCache(indices, (unsigned int)vertices.size());
+		printf("  %u triangles, %u vertices: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f, %s indices\n", (unsigned int)(indices.size() / 3), (unsigned int)vertices.size(),
+			before.acmr, after.acmr, before.atvr, after.atvr, vertices.size() <= 0x10000 ? "16 bit" : "32 bit");
+	}
+}
+
+MeshOptimizer::CacheStats MeshOptimizer::AnalyzeVertexCache(const std::vector<unsigned int>& indices, unsigned int vertexCount)
+{
+	// FIFO cache, a vertex is in the cache if it was inserted less than CacheSize misses ago
+	std::vector<unsigned int> insertedAt(vertexCount, 0);
+	unsigned int misses = 0;
+
+	for (unsigned int i = 0; i < indices.size(); i++)
+	{
+		unsigned int v = indices[i];
+		if (insertedAt[v] == 0 || misses - insertedAt[v] >= (unsigned int)CacheSize)
+		{
+			misses++;
+			insertedAt[v] = misses;
+		}
+	}
+
+	CacheStats stats;
+	stats.acmr = indices.size() >= 3 ? (float)misses / (indices.size() / 3) : 0.0f;
+	stats.atvr = vertexCount > 0 ? (float)misses / vertexCount : 0.0f;
+	return stats;
+}
+
+void MeshOptimizer::OptimizeVertexCache(std::vector<unsigned int>& indices, unsigned int vertexCount, std::vector<unsigned int>* clusters)
+{
+	unsigned int triangleCount = (unsigned int)(indices.size() / 3);
+
+	// triangles around every vertex, compressed rows
+	std::vector<unsigned int> adjacencyOffset(vertexCount + 1, 0);
+	for (unsigned int i = 0; i < triangleCount * 3; i++)
+		adjacencyOffset[indices[i] + 1]++;
+	for (unsigned int v = 0; v < vertexCount; v++)
+		adjacencyOffset[v + 1] += adjacencyOffset[v];
+
+	std::vector<unsigned int> adjacency(triangleCount * 3);
+	std::vector<unsigned int> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+	for (unsigned int i = 0; i < triangleCount * 3; i++)
+		adjacency[fill[indices[i]]++] = i / 3;
+
+	// triangles not emitted yet per vertex
+	std::vector<unsigned int> live(vertexCount);
+	for (unsigned int v = 0; v < vertexCount; v++)
+		live[v] = adjacencyOffset[v + 1] - adjacencyOffset[v];
+
+	std::vector<unsigned int> cacheTime(vertexCount, 0);
+	std::vector<bool> emitted(triangleCount, false);
+	std::vector<unsigned int> deadEnd;
+	std::vector<unsigned int> candidates;
+	std::vector<unsigned int> result;
+	result.reserve(triangleCount * 3);
+
+	if (clusters != NULL)
+		clusters->clear();
+
+	unsigned int time = CacheSize + 1;
+	unsigned int cursor = 0;
+	int fanning = 0;
+	bool newCluster = true;
+
+	while (fanning >= 0)
+	{
+		unsigned int emittedCount = (unsigned int)result.size() / 3;
+		if (newCluster && clusters != NULL && (clusters->empty() || clusters->back() != emittedCount))
+			clusters->push_back(emittedCount);
+		newCluster = false;
+
+		// emit every remaining triangle around the fanning vertex
+		candidates.clear();
+		for (unsigned int a = adjacencyOffset[fanning]; a < adjacencyOffset[fanning + 1]; a++)
+		{
+			unsigned int t = adjacency[a];
+			if (emitted[t])
+				continue;
+
+			for (int c = 0; c < 3; c++)
+			{
+				unsigned int v = indices[t * 3 + c];
+				result.push_back(v);
+				deadEnd.push_back(v);
+				candidates.push_back(v);
+				live[v]--;
+				if (time - cacheTime[v] > (unsigned int)CacheSize)
+					cacheTime[v] = time++;
+			}
+			emitted[t] = true;
+		}
+
+		// next fanning vertex: the oldest candidate that is still in the cache after its remaining triangles were emitted
+		int next = -1;
+		int bestPriority = -1;
+		for (unsigned int c = 0; c < candidates.size(); c++)
+		{
+			unsigned int v = candidates[c];
+			if (live[v] == 0)
+				continue;
+
+			int priority = 0;
+			if (time - cacheTime[v] + 2 * live[v] <= (unsigned int)CacheSize)
+				priority = (int)(time - cacheTime[v]);
+			if (priority > bestPriority)
+			{
+				bestPriority = priority;
+				next = (int)v;
+			}
+		}
+
+		if (next < 0)
+		{
+			// dead end, go back to a recently used vertex or continue with the next vertex in input order
+			// either way the cache is most likely cold, which is where the overdraw pass may split the order
+			newCluster = true;
+			while (!deadEnd.empty() && next < 0)
+			{
+				unsigned int v = deadEnd.back();
+				deadEnd.pop_back();
+				if (live[v] > 0)
+					next = (int)v;
+			}
+			while (next < 0 && cursor < vertexCount)
+			{
+				if (live[cursor] > 0)
+					next = (int)cursor;
+				cursor++;
+			}
+		}
+
+		fanning = next;
+	}
+
+	indices.swap(result);
+}
+
+void MeshOptimizer::OptimizeOverdraw(const std::vector<Vertex>& vertices, std::vector<unsigned int>& indices, const std::vector<unsigned int>& clusters)
+{
+	unsigned int triangleCount = (unsigned int)(indices.size() / 3);
+	if (clusters.size() < 2)
+		return;
+
+	struct Cluster
+	{
+		unsigned int first;
+		unsigned int count;
+		float sortKey;
+	};
+
+	// area weighted centroid and normal of every cluster and of the whole mesh
+	std::vector<Cluster> sorted(clusters.size());
+	std::vector<glm::vec3> centroids(clusters.size());
+	std::vector<glm::vec3> normals(clusters.size());
+	glm::vec3 meshCentroid(0.0f);
+	float meshArea = 0.0f;
+
+	for (unsigned int c = 0; c < clusters.size(); c++)
+	{
+		sorted[c].first = clusters[c];
+		sorted[c].count = (c + 1 < clusters.size() ? clusters[c + 1] : triangleCount) - clusters[c];
+
+		glm::vec3 centroid(0.0f), normal(0.0f);
+		float area = 0.0f;
+		for (unsigned int t = sorted[c].first; t < sorted[c].first + sorted[c].count; t++)
+		{
+			const glm::vec3& p0 = vertices[indices[t * 3]].Position;
+			const glm::vec3& p1 = vertices[indices[t * 3 + 1]].Position;
+			const glm::vec3& p2 = vertices[indices[t * 3 + 2]].Position;
+
+			glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+			float a = glm::length(n);
+			centroid += (p0 + p1 + p2) * (a / 3.0f);
+			normal += n;
+			area += a;
+		}
+
+		meshCentroid += centroid;
+		meshArea += area;
+		centroids[c] = area > 0.0f ? centroid / area : vertices[indices[sorted[c].first * 3]].Position;
+		normals[c] = normal;
+	}
+	if (meshArea > 0.0f)
+		meshCentroid /= meshArea;
+
+	// clusters facing away from the center are likely in front of the ones facing it, draw them first
+	for (unsigned int c = 0; c < clusters.size(); c++)
+	{
+		float length = glm::length(normals[c]);
+		sorted[c].sortKey = length > 0.0f ? glm::dot(centroids[c] - meshCentroid, normals[c] / length) : 0.0f;
+	}
+	std::stable_sort(sorted.begin(), sorted.end(), [](const Cluster& a, const Cluster& b) { return a.sortKey > b.sortKey; });
+
+	std::vector<unsigned int> result;
+	result.reserve(indices.size());
+	for (unsigned int c = 0; c < sorted.size(); c++)
+		result.insert(result.end(), indices.begin() + sorted[c].first * 3, indices.begin() + (sorted[c].first + sorted[c].count) * 3);
+
+	// the split points are cold cache points of the Tipsify order, but sorting still costs a few misses at the seams
+	if (AnalyzeVertexCache(result, (unsigned int)vertices.size()).acmr <= AnalyzeVertexCache(indices, (unsigned int)vertices.size()).acmr * OverdrawCacheThreshold)
+		indices.swap(result);
+}
+
+void MeshOptimizer::OptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices)
+{
+	const unsigned int Unused = 0xFFFFFFFF;
+	std::vector<unsigned int> remap(vertices.size(), Unused);
+	std::vector<Vertex> result;
+	result.reserve(vertices.size());
+
+	for (unsigned int i = 0; i < indices.size(); i++)
+	{
+		unsigned int& r = remap[indices[i]];
+		if (r == Unused)
+		{
+			r = (unsigned int)result.size();
+			result.push_back(vertices[indices[i]]);
+		}
+		indices[i] = r;
+	}
+
+	vertices.swap(result);
+}
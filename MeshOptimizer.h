@@ -0,0 +1,48 @@
+#pragma once
+#ifndef MESHOPTIMIZER_H
+#define MESHOPTIMIZER_H
+
+#include <glm/glm.hpp>
+#include <vector>
+
+struct Vertex;
+
+// reorders triangle lists for the GPU, run on every import (and therefore baked into the .bmesh files)
+//	1. Tipsify (Sander et al. 2007) vertex cache ordering
+//	2. overdraw ordering: the Tipsify clusters are sorted so that outward facing parts of the mesh are drawn first,
+//	   accepted only while the cache miss ratio stays within OverdrawCacheThreshold of the Tipsify order
+//	3. vertex fetch ordering: vertices are renumbered in first use order, unreferenced ones are dropped
+// Mesh::setupMesh then uploads 16 bit indices whenever the vertex count allows it
+class MeshOptimizer
+{
+public:
+	// post-transform cache simulated by the analysis and targeted by Tipsify (FIFO)
+	static const int CacheSize = 16;
+
+	struct CacheStats
+	{
+		// average cache miss ratio, vertex shader runs per triangle (0.5 is ideal for a regular grid, 3 is no reuse at all)
+		float acmr;
+		// average transformed vertex ratio, vertex shader runs per vertex (1 is ideal)
+		float atvr;
+	};
+
+	// all three stages, vertices and indices are rewritten in place
+	static void Optimize(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices);
+
+	static void OptimizeVertexCache(std::vector<unsigned int>& indices, unsigned int vertexCount, std::vector<unsigned int>* clusters = NULL);
+	static void OptimizeOverdraw(const std::vector<Vertex>& vertices, std::vector<unsigned int>& indices, const std::vector<unsigned int>& clusters);
+	static void OptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices);
+
+	static CacheStats AnalyzeVertexCache(const std::vector<unsigned int>& indices, unsigned int vertexCount);
+
+	// prints the before/after statistics of every mesh passing through Optimize, the baker turns it on
+	static void SetReportStats(bool report);
+private:
+	// the overdraw order may cost this much more cache misses than the pure cache order
+	static constexpr float OverdrawCacheThreshold = 1.05f;
+
+	static bool reportStats;
+};
+
+#endif
@@ -0,0 +1,242 @@
+#include "MeshSimplifier.h"
+#include "MeshOptimizer.h"
+#include "Mesh.h"
+#include <algorithm>
+#include <stdint.h>
+
+void MeshSimplifier::Quadric::Reset()
+{
+	a2 = ab = ac = ad = b2 = bc = bd = c2 = cd = d2 = 0.0;
+}
+
+void MeshSimplifier::Quadric::AddPlane(const glm::vec3& n, double d, double weight)
+{
+	double x = n.x, y = n.y, z = n.z;
+	a2 += weight * x * x; ab += weight * x * y; ac += weight * x * z; ad += weight * x * d;
+	b2 += weight * y * y; bc += weight * y * z; bd += weight * y * d;
+	c2 += weight * z * z; cd += weight * z * d;
+	d2 += weight * d * d;
+}
+
+void MeshSimplifier::Quadric::Add(const Quadric& o)
+{
+	a2 += o.a2; ab += o.ab; ac += o.ac; ad += o.ad;
+	b2 += o.b2; bc += o.bc; bd += o.bd;
+	c2 += o.c2; cd += o.cd;
+	d2 += o.d2;
+}
+
+double MeshSimplifier::Quadric::Evaluate(const glm::vec3& p) const
+{
+	double x = p.x, y = p.y, z = p.z;
+	return a2 * x * x + 2.0 * ab * x * y + 2.0 * ac * x * z + 2.0 * ad * x
+		+ b2 * y * y + 2.0 * bc * y * z + 2.0 * bd * y
+		+ c2 * z * z + 2.0 * cd * z
+		+ d2;
+}
+
+std::vector<std::vector<unsigned int>> MeshSimplifier::GenerateLods(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices)
+{
+	std::vector<std::vector<unsigned int>> levels;
+	if (indices.size() / 3 < MinLodTriangles)
+		return levels;
+
+	unsigned int previousCount = (unsigned int)indices.size();
+	for (int level = 1; level < Mesh::MaxLods; level++)
+	{
+		// every level starts from the full mesh, so the errors don't pile up from level to level
+		std::vector<unsigned int> lod;
+		Simplify(vertices, indices, (previousCount / 2) / 3 * 3, lod);
+
+		if (lod.empty() || lod.size() > previousCount * (1.0f - MinLodReduction))
+			break;
+
+		MeshOptimizer::OptimizeVertexCache(lod, (unsigned int)vertices.size());
+		previousCount = (unsigned int)lod.size();
+		levels.push_back(lod);
+	}
+	return levels;
+}
+
+void MeshSimplifier::Simplify(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, unsigned int targetIndexCount, std::vector<unsigned int>& result)
+{
+	unsigned int vertexCount = (unsigned int)vertices.size();
+	result = indices;
+
+	// vertices that must not move: attribute seams (several vertices at one position) and open or non manifold borders
+	std::vector<char> locked(vertexCount, 0);
+
+	std::vector<unsigned int> byPosition(vertexCount);
+	for (unsigned int v = 0; v < vertexCount; v++)
+		byPosition[v] = v;
+	auto positionLess = [&vertices](unsigned int a, unsigned int b)
+	{
+		const glm::vec3& p = vertices[a].Position;
+		const glm::vec3& q = vertices[b].Position;
+		if (p.x != q.x) return p.x < q.x;
+		if (p.y != q.y) return p.y < q.y;
+		return p.z < q.z;
+	};
+	std::sort(byPosition.begin(), byPosition.end(), positionLess);
+	for (unsigned int i = 1; i < vertexCount; i++)
+	{
+		if (vertices[byPosition[i]].Position == vertices[byPosition[i - 1]].Position)
+			locked[byPosition[i]] = locked[byPosition[i - 1]] = 1;
+	}
+
+	std::vector<uint64_t> edges;
+	edges.reserve(indices.size());
+	for (unsigned int i = 0; i < indices.size(); i += 3)
+	{
+		for (int e = 0; e < 3; e++)
+		{
+			unsigned int a = indices[i + e], b = indices[i + (e + 1) % 3];
+			edges.push_back(a < b ? ((uint64_t)a << 32) | b : ((uint64_t)b << 32) | a);
+		}
+	}
+	std::sort(edges.begin(), edges.end());
+	for (size_t i = 0; i < edges.size();)
+	{
+		size_t j = i + 1;
+		while (j < edges.size() && edges[j] == edges[i])
+			j++;
+		if (j - i != 2)
+		{
+			locked[(unsigned int)(edges[i] >> 32)] = 1;
+			locked[(unsigned int)(edges[i] & 0xFFFFFFFF)] = 1;
+		}
+		i = j;
+	}
+
+	// area weighted planes of the triangles around every vertex
+	std::vector<Quadric> quadrics(vertexCount);
+	for (unsigned int v = 0; v < vertexCount; v++)
+		quadrics[v].Reset();
+	for (unsigned int i = 0; i < indices.size(); i += 3)
+	{
+		const glm::vec3& p0 = vertices[indices[i]].Position;
+		const glm::vec3& p1 = vertices[indices[i + 1]].Position;
+		const glm::vec3& p2 = vertices[indices[i + 2]].Position;
+		glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+		float length = glm::length(n);
+		if (length <= 0.0f)
+			continue;
+		n /= length;
+		double d = -(double)glm::dot(n, p0);
+		for (int c = 0; c < 3; c++)
+			quadrics[indices[i + c]].AddPlane(n, d, length * 0.5);
+	}
+
+	std::vector<unsigned int> adjacencyOffset(vertexCount + 1);
+	std::vector<unsigned int> adjacency;
+	std::vector<unsigned int> fill;
+	std::vector<Collapse> collapses;
+	std::vector<char> touched(vertexCount);
+
+	// every pass collapses the cheapest edges whose surroundings no other collapse of the pass changed
+	while (result.size() > targetIndexCount)
+	{
+		unsigned int triangleCount = (unsigned int)(result.size() / 3);
+
+		std::fill(adjacencyOffset.begin(), adjacencyOffset.end(), 0);
+		for (unsigned int i = 0; i < result.size(); i++)
+			adjacencyOffset[result[i] + 1]++;
+		for (unsigned int v = 0; v < vertexCount; v++)
+			adjacencyOffset[v + 1] += adjacencyOffset[v];
+		adjacency.resize(result.size());
+		fill.assign(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+		for (unsigned int i = 0; i < result.size(); i++)
+			adjacency[fill[result[i]]++] = i / 3;
+
+		collapses.clear();
+		for (unsigned int i = 0; i < result.size(); i += 3)
+		{
+			for (int e = 0; e < 3; e++)
+			{
+				unsigned int a = result[i + e], b = result[i + (e + 1) % 3];
+				for (int direction = 0; direction < 2; direction++)
+				{
+					if (!locked[a])
+					{
+						Quadric q = quadrics[a];
+						q.Add(quadrics[b]);
+						Collapse c = { a, b, q.Evaluate(vertices[b].Position) };
+						collapses.push_back(c);
+					}
+					std::swap(a, b);
+				}
+			}
+		}
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& x, const Collapse& y) { return x.error < y.error; });
+
+		std::fill(touched.begin(), touched.end(), 0);
+		unsigned int removeTarget = (unsigned int)(result.size() - targetIndexCount) / 3;
+		unsigned int removed = 0;
+		unsigned int collapsed = 0;
+
+		for (unsigned int c = 0; c < collapses.size() && removed < removeTarget; c++)
+		{
+			unsigned int a = collapses[c].from, b = collapses[c].to;
+			if (touched[a] || touched[b])
+				continue;
+
+			// the triangles that stay must neither flip nor turn too far nor degenerate
+			bool valid = true;
+			unsigned int shared = 0;
+			for (unsigned int k = adjacencyOffset[a]; k < adjacencyOffset[a + 1] && valid; k++)
+			{
+				const unsigned int* t = &result[adjacency[k] * 3];
+				if (t[0] == b || t[1] == b || t[2] == b)
+				{
+					shared++;
+					continue;
+				}
+
+				glm::vec3 p[3], q[3];
+				for (int j = 0; j < 3; j++)
+				{
+					p[j] = vertices[t[j]].Position;
+					q[j] = t[j] == a ? vertices[b].Position : p[j];
+				}
+				glm::vec3 n0 = glm::cross(p[1] - p[0], p[2] - p[0]);
+				glm::vec3 n1 = glm::cross(q[1] - q[0], q[2] - q[0]);
+				float l0 = glm::length(n0), l1 = glm::length(n1);
+				if (l1 <= 0.0f || (l0 > 0.0f && glm::dot(n0, n1) < MinNormalDot * l0 * l1))
+					valid = false;
+			}
+			if (!valid || shared == 0)
+				continue;
+
+			for (unsigned int k = adjacencyOffset[a]; k < adjacencyOffset[a + 1]; k++)
+			{
+				unsigned int* t = &result[adjacency[k] * 3];
+				for (int j = 0; j < 3; j++)
+				{
+					touched[t[j]] = 1;
+					if (t[j] == a)
+						t[j] = b;
+				}
+			}
+			quadrics[b].Add(quadrics[a]);
+			touched[a] = touched[b] = 1;
+			removed += shared;
+			collapsed++;
+		}
+
+		if (collapsed == 0)
+			break;
+
+		// drop the triangles that lost their area to a collapse
+		unsigned int write = 0;
+		for (unsigned int t = 0; t < triangleCount; t++)
+		{
+			unsigned int i0 = result[t * 3], i1 = result[t * 3 + 1], i2 = result[t * 3 + 2];
+			if (i0 == i1 || i1 == i2 || i0 == i2)
+				continue;
+			result[write++] = i0;
+			result[write++] = i1;
+			result[write++] = i2;
+		}
+		result.resize(write);
+	}
+}
@@ -0,0 +1,51 @@
+#pragma once
+#ifndef MESHSIMPLIFIER_H
+#define MESHSIMPLIFIER_H
+
+#include <glm/glm.hpp>
+#include <vector>
+
+struct Vertex;
+
+// quadric error metric simplification (Garland and Heckbert 1997) used to build the levels of detail of every mesh on import
+// vertices are collapsed onto one of their neighbours instead of a new optimal position, so every level is just another
+// index buffer over the mesh's vertices and shares its VBO
+//
+// vertices on open borders and on attribute seams (split by Assimp because of a different normal or uv) stay where they are
+// so the levels don't tear, meshes that consist mostly of those simply get fewer levels
+class MeshSimplifier
+{
+public:
+	// levels 1.. of the mesh (level 0 is the mesh itself), each with about half the triangles of the one before
+	static std::vector<std::vector<unsigned int>> GenerateLods(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices);
+
+	// collapses edges in order of increasing error until about targetIndexCount indices are left (or nothing can collapse)
+	static void Simplify(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, unsigned int targetIndexCount, std::vector<unsigned int>& result);
+private:
+	// symmetric 4x4 matrix of the summed squared plane distances
+	struct Quadric
+	{
+		double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+
+		void Reset();
+		void AddPlane(const glm::vec3& n, double d, double weight);
+		void Add(const Quadric& other);
+		double Evaluate(const glm::vec3& p) const;
+	};
+
+	struct Collapse
+	{
+		unsigned int from;
+		unsigned int to;
+		double error;
+	};
+
+	// meshes below this don't get levels, there isn't enough to save
+	static const unsigned int MinLodTriangles = 64;
+	// a level has to remove at least this fraction of the previous one to be worth a draw of its own
+	static constexpr float MinLodReduction = 0.15f;
+	// largest rotation of a triangle normal a collapse may cause (cosine), also rejects flips
+	static constexpr float MinNormalDot = 0.2f;
+};
+
+#endif
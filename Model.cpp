@@ -1,11 +1,17 @@
 #include "Model.h"
+#include "ResourceCache.h"
+#include "BakedMesh.h"
+#include "BakedTexture.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "MappedFile.h"
 
 #define STB_IMAGE_IMPLEMENTATION //if not defined the function implementations are not included
 #include "stb_image.h"
 
-Model::Model(bool gamma) : gammaCorrection(gamma) { }
+Model::Model(bool gamma) : gammaCorrection(gamma), ready(false) { }
 
-void Model::Draw(Shader shader)
+void Model::Draw(const Shader& shader)
 {
 	for (unsigned int i = 0; i < meshes.size(); i++)
 		meshes[i].Draw(shader);
@@ -13,11 +19,121 @@ void Model::Draw(Shader shader)
 
 void Model::LoadModel(string const& path)
 {
-	loadModel(path);
+	ModelData data;
+	Import(path, data);
+
+	for (int i = 0; i < (int)data.textures.size(); i++)
+		UploadTexture(data, i);
+	for (int i = 0; i < (int)data.meshes.size(); i++)
+		UploadMesh(data, i);
+
+	Adopt(data);
+}
+
+bool Model::IsReady() const
+{
+	return ready;
+}
+
+int Model::GetLodCount() const
+{
+	int count = 1;
+	for (unsigned int i = 0; i < meshes.size(); i++)
+		count = std::max(count, meshes[i].GetLodCount());
+	return count;
+}
+
+void Model::Adopt(ModelData& data)
+{
+	directory = data.directory;
+	meshes = std::move(data.meshes);
+	textures_loaded.insert(textures_loaded.end(), data.textures.begin(), data.textures.end());
+	textureResources.insert(textureResources.end(), data.resources.begin(), data.resources.end());
+	ready = true;
+}
+
+void Model::UploadTexture(ModelData& data, int i)
+{
+	Texture& texture = data.textures[i];
+	// another model may have uploaded the shared texture already
+	texture.id = data.resources[i]->Upload();
+
+	// the meshes got copies of the Texture while the id was still unknown
+	for (unsigned int m = 0; m < data.meshes.size(); m++)
+	{
+		vector<Texture>& meshTextures = data.meshes[m].textures;
+		for (unsigned int t = 0; t < meshTextures.size(); t++)
+		{
+			if (meshTextures[t].path == texture.path)
+				meshTextures[t].id = texture.id;
+		}
+	}
+}
+
+void Model::UploadMesh(ModelData& data, int i)
+{
+	data.meshes[i].Upload();
+}
+
+bool Model::Raycast(const glm::vec3& orig, const glm::vec3& dir, float tMax, float& t) const
+{
+	bool hit = false;
+	for (unsigned int i = 0; i < meshes.size(); i++)
+	{
+		float meshT;
+		if (meshes[i].bvh.Raycast(orig, dir, tMax, meshT) >= 0)
+		{
+			tMax = meshT;
+			t = meshT;
+			hit = true;
+		}
+	}
+	return hit;
 }
 
 bool Model::LoadTexture(const char* filename, GLuint& texID)
 {
+	// no GL context to upload to and nothing samples the texture, skip decoding as well
+	if (Headless::IsEnabled())
+	{
+		texID = 0;
+		return true;
+	}
+
+	DecodedImage image;
+	if (!DecodeImage(filename, image))
+	{
+		texID = 0;
+		return false;
+	}
+
+	texID = UploadImage(image);
+	return true;
+}
+
+bool Model::DecodeImage(const char* filename, DecodedImage& image)
+{
+	image.pixels = NULL;
+	image.compressedFormat = 0;
+	image.levels = 1;
+	image.compressed = NULL;
+	image.mapping = NULL;
+
+	if (BakedTexture::Read(filename, image))
+		return true;
+
+	// read the texture
+	//stbi_set_flip_vertically_on_load(true); //flip the image vertically while loading
+	image.pixels = stbi_load(filename, &image.width, &image.height, &image.channels, 0); //read the image data
+	return image.pixels != NULL;
+}
+
+GLuint Model::UploadImage(DecodedImage& image)
+{
+	if ((image.pixels == NULL && image.compressed == NULL) || Headless::IsEnabled())
+		return 0;
+
+	GLuint texID;
 	glGenTextures(1, &texID);
 	glBindTexture(GL_TEXTURE_2D, texID);
 	// set the texture wrapping/filtering options (on the currently bound texture object)
@@ -26,53 +142,111 @@ bool Model::LoadTexture(const char* filename, GLuint& texID)
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-	// read the texture
-	GLint width, height, channels;
-	//stbi_set_flip_vertically_on_load(true); //flip the image vertically while loading
-	unsigned char* img_data = stbi_load(filename, &width, &height, &channels, 0); //read the image data
-
-	if (!img_data)
+	if (image.compressed != NULL)
 	{
-		return false;
+		// baked mip chain, uploaded as is from the mapped file
+		BakedTexture::Upload(image);
 	}
-	//3 channels - rgb, 4 channels - RGBA
-	GLenum format;
-	switch (channels)
+	else
 	{
-	case 4:
-		format = GL_RGBA;
-		break;
-	default:
-		format = GL_RGB;
-		break;
+		//3 channels - rgb, 4 channels - RGBA
+		GLenum format;
+		switch (image.channels)
+		{
+		case 4:
+			format = GL_RGBA;
+			break;
+		default:
+			format = GL_RGB;
+			break;
+		}
+		glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, image.pixels);
+		glGenerateMipmap(GL_TEXTURE_2D);
 	}
-	glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, img_data);
-	glGenerateMipmap(GL_TEXTURE_2D);
 
-	stbi_image_free(img_data);
+	FreeImage(image);
 
-	return true;
+	return texID;
+}
+
+void Model::FreeImage(DecodedImage& image)
+{
+	if (image.pixels != NULL)
+		stbi_image_free(image.pixels);
+	image.pixels = NULL;
+
+	delete image.mapping;
+	image.mapping = NULL;
+	image.compressed = NULL;
 }
 
-void Model::loadModel(string const& path)
+TextureResource::TextureResource() : id(0), decoded(false)
 {
-	// read file via ASSIMP
+	image.pixels = NULL;
+	image.compressed = NULL;
+	image.mapping = NULL;
+}
+
+TextureResource::~TextureResource()
+{
+	Model::FreeImage(image);
+	if (id != 0)
+		glDeleteTextures(1, &id);
+}
+
+bool TextureResource::Decode(const string& path)
+{
+	std::call_once(decodeOnce, [this, &path] { decoded = Model::DecodeImage(path.c_str(), image); });
+	return decoded;
+}
+
+GLuint TextureResource::Upload()
+{
+	if (id == 0)
+		id = Model::UploadImage(image);
+	return id;
+}
+
+bool Model::Import(string const& path, ModelData& data)
+{
+	data.valid = false;
+	// retrieve the directory path of the filepath
+	data.directory = path.substr(0, path.find_last_of('/'));
+
+	// the baked file skips the Assimp import, Assimp is only needed when it is missing or stale
+	if (BakedMesh::Read(path, data))
+	{
+		data.valid = true;
+		return true;
+	}
+
+	return ImportSource(path, data);
+}
+
+bool Model::ImportSource(string const& path, ModelData& data)
+{
+	data.valid = false;
+
+	// read file via ASSIMP, an Importer per call so that several imports can run in parallel
 	Assimp::Importer importer;
 	const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
 	// check for errors
 	if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
 	{
 		cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
-		return;
+		return false;
 	}
 	// retrieve the directory path of the filepath
-	directory = path.substr(0, path.find_last_of('/'));
+	data.directory = path.substr(0, path.find_last_of('/'));
 
 	// process ASSIMP's root node recursively
-	processNode(scene->mRootNode, scene);
+	processNode(scene->mRootNode, scene, data);
+
+	data.valid = true;
+	return true;
 }
 
-void Model::processNode(aiNode* node, const aiScene* scene)
+void Model::processNode(aiNode* node, const aiScene* scene, ModelData& data)
 {
 	// process each mesh located at the current node
 	for (unsigned int i = 0; i < node->mNumMeshes; i++)
@@ -80,16 +254,16 @@ void Model::processNode(aiNode* node, const aiScene* scene)
 		// the node object only contains indices to index the actual objects in the scene. 
 		// the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
 		aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-		meshes.push_back(processMesh(mesh, scene));
+		data.meshes.push_back(processMesh(mesh, scene, data));
 	}
 	// after we've processed all of the meshes (if any) we then recursively process each of the children nodes
 	for (unsigned int i = 0; i < node->mNumChildren; i++)
 	{
-		processNode(node->mChildren[i], scene);
+		processNode(node->mChildren[i], scene, data);
 	}
 }
 
-Mesh Model::processMesh(aiMesh* mesh, const aiScene* scene)
+Mesh Model::processMesh(aiMesh* mesh, const aiScene* scene, ModelData& data)
 {
 	// data to fill
 	vector<Vertex> vertices;
@@ -156,53 +330,63 @@ Mesh Model::processMesh(aiMesh* mesh, const aiScene* scene)
 	// normal: texture_normalN
 
 	// 1. diffuse maps
-	vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
+	vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse", data);
 	textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
 	// 2. specular maps
-	vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
+	vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular", data);
 	textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
 	// 3. normal maps
-	std::vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
+	std::vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal", data);
 	textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
 	// 4. height maps
-	std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
+	std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height", data);
 	textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
 
-	// return a mesh object created from the extracted mesh data
-	return Mesh(vertices, indices, textures);
+	// Assimp keeps the file's triangle order, reorder it for the post-transform cache and overdraw
+	MeshOptimizer::Optimize(vertices, indices);
+
+	// return a mesh object created from the extracted mesh data, the GL buffers are created by UploadMesh
+	Mesh result(std::move(vertices), std::move(indices), std::move(textures), false);
+	// simplified versions for distant draws, see ModelNode::SelectLod
+	result.SetLods(MeshSimplifier::GenerateLods(result.vertices, result.indices));
+	return result;
 }
 
-vector<Texture> Model::loadMaterialTextures(aiMaterial* mat, aiTextureType type, string typeName)
+vector<Texture> Model::loadMaterialTextures(aiMaterial* mat, aiTextureType type, string typeName, ModelData& data)
 {
 	vector<Texture> textures;
 	for (unsigned int i = 0; i < mat->GetTextureCount(type); i++)
 	{
 		aiString str;
 		mat->GetTexture(type, i, &str);
-		// check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-		bool skip = false;
-		for (unsigned int j = 0; j < textures_loaded.size(); j++)
-		{
-			if (std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
-			{
-				textures.push_back(textures_loaded[j]);
-				skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
-				break;
-			}
-		}
-		if (!skip)
-		{   // if texture hasn't been loaded already, load it
-			Texture texture;
-			string path = directory + '/' + string(str.C_Str());
-			if (!LoadTexture(path.c_str(), texture.id))
-			{
-				std::cout << "Unable to load texture " << str.C_Str() << endl;
-			}
-			texture.type = typeName;
-			texture.path = str.C_Str();
-			textures.push_back(texture);
-			textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
-		}
+		textures.push_back(AddMaterialTexture(str.C_Str(), typeName, data));
 	}
 	return textures;
-}
\ No newline at end of file
+}
+
+Texture Model::AddMaterialTexture(const string& file, const string& typeName, ModelData& data)
+{
+	// check if texture was loaded before and if so, return it: skip loading a new texture
+	for (unsigned int j = 0; j < data.textures.size(); j++)
+	{
+		if (data.textures[j].path == file)
+			return data.textures[j]; // a texture with the same filepath has already been loaded (optimization)
+	}
+
+	// if texture hasn't been loaded already, decode it, unless another model shares it and did so already
+	// the GL texture is created by UploadTexture
+	Texture texture;
+	string path = data.directory + '/' + file;
+	std::shared_ptr<TextureResource> resource = ResourceCache::GetInstance()->AcquireTexture(path);
+	// no GL context to upload to and nothing samples the texture, skip decoding as well
+	if (!Headless::IsEnabled() && !resource->Decode(path))
+	{
+		std::cout << "Unable to load texture " << file << endl;
+	}
+	texture.id = 0;
+	texture.type = typeName;
+	texture.path = file;
+	data.textures.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
+	data.resources.push_back(resource);
+	return texture;
+}
@@ -21,12 +21,62 @@
 #include <iostream>
 #include <map>
 #include <vector>
+#include <memory>
+#include <mutex>
+
+class MappedFile;
+
+// pixels decoded by stb_image, or the mapped mip chain of a baked texture, freed by Model::UploadImage
+struct DecodedImage
+{
+	unsigned char* pixels;
+	int width;
+	int height;
+	int channels;
+
+	// baked textures only (see BakedTexture), compressedFormat is 0 for stb_image pixels
+	GLenum compressedFormat;
+	int levels;
+	const unsigned char* compressed;
+	MappedFile* mapping;
+};
+
+// texture shared by every model that references the same file, handed out by ResourceCache
+struct TextureResource
+{
+	GLuint id;
+	DecodedImage image;
+
+	TextureResource();
+	~TextureResource();
+
+	// decodes the file the first time, concurrent callers wait for it, false if the file couldn't be read
+	bool Decode(const string& path);
+	// creates the GL texture on first use and frees the pixels, GL thread only
+	GLuint Upload();
+private:
+	std::once_flag decodeOnce;
+	bool decoded;
+};
+
+// CPU side result of Model::Import, built on any thread and turned into GL objects on the GL thread
+struct ModelData
+{
+	string directory;
+	// not uploaded yet, their texture ids are filled in by Model::UploadTexture
+	vector<Mesh> meshes;
+	// every distinct texture of the model, resources[i] is the shared texture behind textures[i]
+	vector<Texture> textures;
+	vector<std::shared_ptr<TextureResource>> resources;
+	bool valid;
+};
 
 class Model
 {
 public:
 	/*  Model Data */
 	vector<Texture> textures_loaded;	// stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
+	vector<std::shared_ptr<TextureResource>> textureResources;	// keeps the shared textures of textures_loaded alive
 	vector<Mesh> meshes;
 	string directory;
 	bool gammaCorrection;
@@ -36,25 +86,52 @@ public:
 	Model(bool gamma = false);
 
 	// draws the model, and thus all its meshes
-	void Draw(Shader shader);
+	void Draw(const Shader& shader);
 
+	// imports and uploads right away, AssetLoader::LoadModelAsync does the same off the GL thread
 	void LoadModel(string const& path);
 
+	// false until LoadModel (or the asset loader) put the meshes in place
+	bool IsReady() const;
+
+	// levels of detail of the mesh that has the most, draws of a level a mesh lacks use its coarsest one
+	int GetLodCount() const;
+
+	// baked mesh (or Assimp import) and image decoding, touches no GL or Model state so it can run on a worker thread
+	static bool Import(string const& path, ModelData& data);
+	// Assimp only, ignores the baked file, used by the baker
+	static bool ImportSource(string const& path, ModelData& data);
+	// adds the material texture file (relative to data.directory) to the model unless it has it already
+	static Texture AddMaterialTexture(const string& file, const string& typeName, ModelData& data);
+	// GL side of an import, one texture or mesh at a time so the work can be spread over several frames
+	static void UploadTexture(ModelData& data, int i);
+	static void UploadMesh(ModelData& data, int i);
+	// takes the meshes of a fully uploaded import, the model is ready afterwards
+	void Adopt(ModelData& data);
+
+	// prefers the baked compressed texture of the file, decodes the file itself otherwise
+	static bool DecodeImage(const char* filename, DecodedImage& image);
+	// creates the GL texture and frees the pixels, 0 if there are none
+	static GLuint UploadImage(DecodedImage& image);
+	static void FreeImage(DecodedImage& image);
+
+	// closest triangle hit of all meshes with t < tMax, the ray is in model space
+	bool Raycast(const glm::vec3& orig, const glm::vec3& dir, float tMax, float& t) const;
+
 	static bool LoadTexture(const char* filename, GLuint& texID);
 
 private:
-	/*  Functions   */
-	// loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
-	void loadModel(string const& path);
+	bool ready;
 
+	/*  Functions   */
 	// processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
-	void processNode(aiNode* node, const aiScene* scene);
+	static void processNode(aiNode* node, const aiScene* scene, ModelData& data);
 
-	Mesh processMesh(aiMesh* mesh, const aiScene* scene);
+	static Mesh processMesh(aiMesh* mesh, const aiScene* scene, ModelData& data);
 
-	// checks all material textures of a given type and loads the textures if they're not loaded yet.
+	// checks all material textures of a given type and decodes the textures if they're not decoded yet.
 	// the required info is returned as a Texture struct.
-	vector<Texture> loadMaterialTextures(aiMaterial* mat, aiTextureType type, string typeName);
+	static vector<Texture> loadMaterialTextures(aiMaterial* mat, aiTextureType type, string typeName, ModelData& data);
 };
 
 #endif
\ No newline at end of file
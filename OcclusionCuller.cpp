@@ -0,0 +1,194 @@
+#include "OcclusionCuller.h"
+#include "Profiler.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <string.h>
+
+OcclusionCuller* OcclusionCuller::cullerInstance = 0;
+
+static const char* boxVertexShader =
+	"#version 330 core\n"
+	"layout (location = 0) in vec3 aPos;\n"
+	"uniform mat4 model;\n"
+	"uniform mat4 view;\n"
+	"uniform mat4 proj;\n"
+	"void main() { gl_Position = proj * view * model * vec4(aPos, 1.0); }\n";
+
+static const char* boxFragmentShader =
+	"#version 330 core\n"
+	"out vec4 FragColor;\n"
+	"void main() { FragColor = vec4(1.0); }\n";
+
+OcclusionCuller::OcclusionCuller()
+	: eye(0.0f), proj(1.0f), view(1.0f), frame(0), boxShader("occlusion_box"), boxVAO(0), boxVBO(0), boxEBO(0), glCreated(false)
+{
+	memset(&stats, 0, sizeof(stats));
+}
+
+OcclusionCuller* OcclusionCuller::GetInstance()
+{
+	if (!cullerInstance)
+		cullerInstance = new OcclusionCuller;
+	return cullerInstance;
+}
+
+const OcclusionCuller::Stats& OcclusionCuller::GetStats() const
+{
+	return stats;
+}
+
+void OcclusionCuller::CreateGLObjects()
+{
+	boxShader.Compile(boxVertexShader, boxFragmentShader);
+
+	// unit cube, scaled and moved onto the bounds of every query
+	float vertices[] = {
+		0.0f, 0.0f, 0.0f,	1.0f, 0.0f, 0.0f,	1.0f, 1.0f, 0.0f,	0.0f, 1.0f, 0.0f,
+		0.0f, 0.0f, 1.0f,	1.0f, 0.0f, 1.0f,	1.0f, 1.0f, 1.0f,	0.0f, 1.0f, 1.0f
+	};
+	unsigned int indices[] = {
+		0, 1, 2, 2, 3, 0,	4, 6, 5, 6, 4, 7,
+		0, 3, 7, 7, 4, 0,	1, 5, 6, 6, 2, 1,
+		0, 4, 5, 5, 1, 0,	3, 2, 6, 6, 7, 3
+	};
+
+	glGenVertexArrays(1, &boxVAO);
+	glGenBuffers(1, &boxVBO);
+	glGenBuffers(1, &boxEBO);
+
+	glBindVertexArray(boxVAO);
+	glBindBuffer(GL_ARRAY_BUFFER, boxVBO);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, boxEBO);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+
+	glBindVertexArray(0);
+
+	glCreated = true;
+}
+
+void OcclusionCuller::Begin(const glm::vec3& eyePos, const glm::mat4& proj, const glm::mat4& view)
+{
+	this->eye = eyePos;
+	this->proj = proj;
+	this->view = view;
+	frame++;
+
+	queued.clear();
+	memset(&stats, 0, sizeof(stats));
+}
+
+void OcclusionCuller::Reset(OcclusionState& state)
+{
+	state.occluded = false;
+}
+
+void OcclusionCuller::Release(OcclusionState& state)
+{
+	for (auto it = queued.begin(); it != queued.end(); )
+	{
+		if (it->state == &state)
+			it = queued.erase(it);
+		else
+			++it;
+	}
+
+	if (state.query != 0)
+	{
+		glDeleteQueries(1, &state.query);
+		state.query = 0;
+	}
+	state.queryPending = false;
+}
+
+bool OcclusionCuller::IsOccluded(OcclusionState& state, const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+	stats.tested++;
+
+	// pick up the result of the last query if the GPU is done with it, never wait for it
+	if (state.queryPending)
+	{
+		GLuint available = 0;
+		glGetQueryObjectuiv(state.query, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (available)
+		{
+			GLuint samples = 0;
+			glGetQueryObjectuiv(state.query, GL_QUERY_RESULT, &samples);
+			state.occluded = samples == 0;
+			state.queryPending = false;
+		}
+	}
+
+	// from inside the box its faces are behind the near plane or behind the eye, the query would say hidden
+	const float margin = 0.5f;
+	if (eye.x >= boundsMin.x - margin && eye.y >= boundsMin.y - margin && eye.z >= boundsMin.z - margin &&
+		eye.x <= boundsMax.x + margin && eye.y <= boundsMax.y + margin && eye.z <= boundsMax.z + margin)
+	{
+		state.occluded = false;
+		return false;
+	}
+
+	if (!state.queryPending && (state.occluded || frame - state.lastQueryFrame >= VisibleQueryInterval))
+	{
+		PendingQuery q;
+		q.state = &state;
+		q.boundsMin = boundsMin;
+		q.boundsMax = boundsMax;
+		queued.push_back(q);
+	}
+
+	if (state.occluded)
+	{
+		stats.occludedNodes++;
+		stats.culledDraws += state.lastDrawCount;
+	}
+
+	return state.occluded;
+}
+
+void OcclusionCuller::IssueQueries()
+{
+	if (queued.empty())
+		return;
+
+	PROFILE_ZONE("OcclusionCuller::IssueQueries");
+
+	if (!glCreated)
+		CreateGLObjects();
+
+	boxShader.use();
+	boxShader.setMat4(Shader::UNIFORM_PROJ, proj);
+	boxShader.setMat4(Shader::UNIFORM_VIEW, view);
+
+	// only depth testing, the boxes must not show up or hide anything drawn afterwards
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	glDepthMask(GL_FALSE);
+
+	glBindVertexArray(boxVAO);
+
+	for (size_t i = 0; i < queued.size(); i++)
+	{
+		OcclusionState& state = *queued[i].state;
+		if (state.query == 0)
+			glGenQueries(1, &state.query);
+
+		glm::mat4 model = glm::translate(glm::mat4(1.0f), queued[i].boundsMin);
+		model = glm::scale(model, queued[i].boundsMax - queued[i].boundsMin);
+		boxShader.setMat4(Shader::UNIFORM_MODEL, model);
+
+		glBeginQuery(GL_ANY_SAMPLES_PASSED, state.query);
+		glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+		glEndQuery(GL_ANY_SAMPLES_PASSED);
+
+		state.queryPending = true;
+		state.lastQueryFrame = frame;
+		stats.queriesIssued++;
+	}
+
+	glBindVertexArray(0);
+
+	glDepthMask(GL_TRUE);
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+}
@@ -0,0 +1,87 @@
+#pragma once
+#ifndef OCCLUSIONCULLER_H
+#define OCCLUSIONCULLER_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <stdint.h>
+#include "Shader.h"
+
+// per node occlusion state, owned by the scene graph node it belongs to
+struct OcclusionState
+{
+	GLuint query = 0;
+	bool queryPending = false;
+	// result of the last query that came back, nodes start out visible
+	bool occluded = false;
+	uint32_t lastQueryFrame = 0;
+	// packets the subtree queued the last time it was drawn, reported as culled draws while it is hidden
+	int lastDrawCount = 0;
+};
+
+// hardware occlusion culling of scene graph subtrees
+// after the scene is drawn, the world bounding box of every tested subtree is rasterized against the depth buffer inside a
+// GL_ANY_SAMPLES_PASSED query. The result is read back on a later frame without waiting, so a subtree is hidden only after
+// a previous frame proved it hidden and stays at its last known visibility while its query is still in flight
+class OcclusionCuller
+{
+public:
+	struct Stats
+	{
+		int tested;
+		int occludedNodes;
+		int culledDraws;
+		int queriesIssued;
+	};
+
+	static OcclusionCuller* GetInstance();
+
+	void Begin(const glm::vec3& eyePos, const glm::mat4& proj, const glm::mat4& view);
+
+	// true if the subtree with the given world bounds should be skipped this frame, queues a query for it when one is due
+	bool IsOccluded(OcclusionState& state, const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+
+	// a subtree outside the frustum forgets its result, it could come back into view behind nothing
+	void Reset(OcclusionState& state);
+
+	// frees the query of a node that is being destroyed, and drops its box if it is still queued for this frame
+	void Release(OcclusionState& state);
+
+	// draws the queued bounding boxes inside their queries, call once the occluders are in the depth buffer
+	void IssueQueries();
+
+	const Stats& GetStats() const;
+private:
+	OcclusionCuller();
+
+	struct PendingQuery
+	{
+		OcclusionState* state;
+		glm::vec3 boundsMin;
+		glm::vec3 boundsMax;
+	};
+
+	// visible subtrees are checked again only every few frames, occluded ones every frame
+	static const uint32_t VisibleQueryInterval = 4;
+
+	std::vector<PendingQuery> queued;
+
+	glm::vec3 eye;
+	glm::mat4 proj;
+	glm::mat4 view;
+	uint32_t frame;
+	Stats stats;
+
+	Shader boxShader;
+	GLuint boxVAO;
+	GLuint boxVBO;
+	GLuint boxEBO;
+	bool glCreated;
+
+	void CreateGLObjects();
+
+	static OcclusionCuller* cullerInstance;
+};
+
+#endif
@@ -1,5 +1,6 @@
 #include "PlayerNode.h"
 #include "Player.h"
+#include "SceneBVH.h"
 
 PlayerNode::PlayerNode(Player* pl)
 	: ModelNode("playerNode")
@@ -28,6 +29,19 @@ void PlayerNode::TraverseIntersection(const glm::vec3& orig, const glm::vec3& di
 	//}
 }
 
+void PlayerNode::TraverseBounds(const glm::mat4& transform, SceneBVH* bvh)
+{
+	// the player sphere is already kept in world space by UpdateBoundingPosition
+	traversalBounds.AddSphere(sphere->GetWorldCenter(), sphere->GetWorldRadius());
+
+	if (bvh == NULL)
+		return;
+
+	intersectPath.push_back(this);
+	bvh->AddPrimitive(*sphere, intersectPath, transform, NULL);
+	intersectPath.pop_back();
+}
+
 void PlayerNode::DecreaseHealth()
 {
 	pl->DecreaseHealth();
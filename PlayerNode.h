@@ -14,6 +14,7 @@ public:
 
 	void Visualize(const glm::mat4& transform); // override
 	void TraverseIntersection(const glm::vec3& orig, const glm::vec3& dir, std::vector<Intersection*>& hits); //override
+	void TraverseBounds(const glm::mat4& transform, SceneBVH* bvh); //override
 
 	void UpdateBoundingPosition(const glm::vec3& pos);
 	void DecreaseHealth();
@@ -0,0 +1,168 @@
+#include "Profiler.h"
+#include "Headless.h"
+#include <stdio.h>
+#include <chrono>
+
+Profiler* Profiler::profilerInstance = 0;
+
+Profiler::Profiler()
+	: eventCount(0), frame(0), depth(0), gpuDepth(0), gpuQueriesCreated(false), gpuToCpuOffsetNs(0)
+{
+	events = new Event[Capacity];
+	for (int i = 0; i < GpuFrameLatency; i++)
+		gpuZoneCount[i] = 0;
+}
+
+Profiler* Profiler::GetInstance()
+{
+	if (!profilerInstance)
+		profilerInstance = new Profiler;
+	return profilerInstance;
+}
+
+uint64_t Profiler::NowNs() const
+{
+	static const auto start = std::chrono::steady_clock::now();
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+void Profiler::BeginFrame()
+{
+	frame++;
+
+	// the slot we are about to reuse was recorded GpuFrameLatency frames ago, its queries should be done by now
+	int slot = frame % GpuFrameLatency;
+	ResolveGpuFrame(slot);
+	gpuZoneCount[slot] = 0;
+}
+
+int Profiler::BeginZone(const char* name)
+{
+	int zone = (int)(eventCount++ & (Capacity - 1));
+
+	Event& e = events[zone];
+	e.name = name;
+	e.frame = frame;
+	e.depth = depth++;
+	e.gpu = 0;
+	e.endNs = 0;
+	e.startNs = NowNs();
+
+	return zone;
+}
+
+void Profiler::EndZone(int zone)
+{
+	events[zone].endNs = NowNs();
+	depth--;
+}
+
+void Profiler::CreateGpuQueries()
+{
+	for (int f = 0; f < GpuFrameLatency; f++)
+	{
+		for (int z = 0; z < MaxGpuZonesPerFrame; z++)
+		{
+			glGenQueries(2, gpuZones[f][z].queries);
+		}
+	}
+
+	// GL timestamps have their own origin, line them up with the CPU clock once
+	GLint64 gpuNow = 0;
+	glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+	gpuToCpuOffsetNs = (int64_t)NowNs() - (int64_t)gpuNow;
+
+	gpuQueriesCreated = true;
+}
+
+int Profiler::BeginGpuZone(const char* name)
+{
+	// timer queries are core since GL 3.3, which is what the engine asks SDL for
+	if (Headless::IsEnabled() || !(GLEW_VERSION_3_3 || GLEW_ARB_timer_query))
+		return -1;
+
+	if (!gpuQueriesCreated)
+		CreateGpuQueries();
+
+	int slot = frame % GpuFrameLatency;
+	if (gpuZoneCount[slot] >= MaxGpuZonesPerFrame)
+		return -1;
+
+	int zone = gpuZoneCount[slot]++;
+	GpuZone& z = gpuZones[slot][zone];
+	z.name = name;
+	z.depth = gpuDepth++;
+	glQueryCounter(z.queries[0], GL_TIMESTAMP);
+
+	return zone;
+}
+
+void Profiler::EndGpuZone(int zone)
+{
+	if (zone < 0)
+		return;
+
+	int slot = frame % GpuFrameLatency;
+	glQueryCounter(gpuZones[slot][zone].queries[1], GL_TIMESTAMP);
+	gpuDepth--;
+}
+
+void Profiler::ResolveGpuFrame(int slot)
+{
+	if (gpuZoneCount[slot] == 0)
+		return;
+
+	// if the last query of the frame isn't ready the GPU is lagging more than GpuFrameLatency frames, drop the frame rather than stall
+	GLint available = 0;
+	glGetQueryObjectiv(gpuZones[slot][gpuZoneCount[slot] - 1].queries[1], GL_QUERY_RESULT_AVAILABLE, &available);
+	if (!available)
+		return;
+
+	for (int i = 0; i < gpuZoneCount[slot]; i++)
+	{
+		GpuZone& z = gpuZones[slot][i];
+		GLuint64 start = 0, end = 0;
+		glGetQueryObjectui64v(z.queries[0], GL_QUERY_RESULT, &start);
+		glGetQueryObjectui64v(z.queries[1], GL_QUERY_RESULT, &end);
+
+		Event& e = events[eventCount++ & (Capacity - 1)];
+		e.name = z.name;
+		e.frame = frame - GpuFrameLatency;
+		e.depth = z.depth;
+		e.gpu = 1;
+		e.startNs = (uint64_t)((int64_t)start + gpuToCpuOffsetNs);
+		e.endNs = (uint64_t)((int64_t)end + gpuToCpuOffsetNs);
+	}
+}
+
+bool Profiler::ExportChromeTrace(const std::string& path)
+{
+	FILE* file = fopen(path.c_str(), "w");
+	if (file == NULL)
+	{
+		printf("Profiler: unable to write trace to %s\n", path.c_str());
+		return false;
+	}
+
+	fprintf(file, "{\"traceEvents\":[\n");
+	fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"CPU\"}},\n");
+	fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"GPU\"}}");
+
+	// oldest event still in the ring first
+	uint64_t first = eventCount > Capacity ? eventCount - Capacity : 0;
+	for (uint64_t i = first; i < eventCount; i++)
+	{
+		const Event& e = events[i & (Capacity - 1)];
+		if (e.endNs == 0 || e.endNs < e.startNs)
+			continue; // zone still open
+
+		fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%u,\"depth\":%u}}",
+			e.name, e.gpu ? 2 : 1, e.startNs / 1000.0, (e.endNs - e.startNs) / 1000.0, e.frame, (unsigned int)e.depth);
+	}
+
+	fprintf(file, "\n]}\n");
+	fclose(file);
+
+	printf("Profiler: trace written to %s\n", path.c_str());
+	return true;
+}
@@ -0,0 +1,102 @@
+#pragma once
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <GL/glew.h>
+#include <string>
+#include <stdint.h>
+
+// comment out to compile every profiler zone out of the build
+#define PROFILER_ENABLED
+
+// scoped CPU/GPU zone profiler, zones nest and are recorded into a fixed ring buffer (no allocation while running)
+// GPU zones use GL timestamp queries which are read back a few frames later so the CPU never waits on the GPU
+// the recorded timeline can be exported to the Chrome trace JSON format (chrome://tracing, ui.perfetto.dev)
+class Profiler
+{
+public:
+	static Profiler* GetInstance();
+
+	void BeginFrame();
+
+	int BeginZone(const char* name);
+	void EndZone(int zone);
+
+	int BeginGpuZone(const char* name);
+	void EndGpuZone(int zone);
+
+	bool ExportChromeTrace(const std::string& path);
+private:
+	Profiler();
+
+	struct Event
+	{
+		const char* name;
+		uint64_t startNs;
+		uint64_t endNs;
+		uint32_t frame;
+		uint16_t depth;
+		uint8_t gpu;
+	};
+
+	struct GpuZone
+	{
+		const char* name;
+		uint16_t depth;
+		GLuint queries[2];
+	};
+
+	// power of two so the ring index is a mask
+	static const int Capacity = 1 << 16;
+	static const int GpuFrameLatency = 4;
+	static const int MaxGpuZonesPerFrame = 32;
+
+	Event* events;
+	uint64_t eventCount;
+
+	uint32_t frame;
+	uint16_t depth;
+	uint16_t gpuDepth;
+
+	GpuZone gpuZones[GpuFrameLatency][MaxGpuZonesPerFrame];
+	int gpuZoneCount[GpuFrameLatency];
+	bool gpuQueriesCreated;
+	int64_t gpuToCpuOffsetNs;
+
+	uint64_t NowNs() const;
+	void ResolveGpuFrame(int slot);
+	void CreateGpuQueries();
+
+	static Profiler* profilerInstance;
+};
+
+class ProfileZone
+{
+public:
+	ProfileZone(const char* name) : zone(Profiler::GetInstance()->BeginZone(name)) { }
+	~ProfileZone() { Profiler::GetInstance()->EndZone(zone); }
+private:
+	int zone;
+};
+
+class ProfileGpuZone
+{
+public:
+	ProfileGpuZone(const char* name) : zone(Profiler::GetInstance()->BeginGpuZone(name)) { }
+	~ProfileGpuZone() { Profiler::GetInstance()->EndGpuZone(zone); }
+private:
+	int zone;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+#ifdef PROFILER_ENABLED
+#define PROFILE_ZONE(name) ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#define PROFILE_GPU_ZONE(name) ProfileGpuZone PROFILE_CONCAT(profileGpuZone, __LINE__)(name)
+#else
+#define PROFILE_ZONE(name)
+#define PROFILE_GPU_ZONE(name)
+#endif
+
+#endif
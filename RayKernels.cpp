@@ -0,0 +1,832 @@
+#include "RayKernels.h"
+#include "BoundingObjects.h"
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <chrono>
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#include <emmintrin.h>
+#define RAYKERNELS_SSE
+#endif
+
+// the AVX kernels are compiled without /arch:AVX and picked at runtime, so the game still starts on CPUs without AVX
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <immintrin.h>
+#include <intrin.h>
+#define RAYKERNELS_AVX
+#define RAYKERNELS_AVX_TARGET
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define RAYKERNELS_AVX
+#define RAYKERNELS_AVX_TARGET __attribute__((target("avx")))
+#endif
+
+#ifdef RAYKERNELS_AVX
+static bool DetectAVX()
+{
+#if defined(_MSC_VER)
+	// AVX and OSXSAVE in cpuid, then the OS has to save the YMM registers on context switches
+	int info[4];
+	__cpuid(info, 1);
+	if ((info[2] & (1 << 28)) == 0 || (info[2] & (1 << 27)) == 0)
+		return false;
+	return (_xgetbv(0) & 6) == 6;
+#else
+	return __builtin_cpu_supports("avx") != 0;
+#endif
+}
+
+static const bool hasAVX = DetectAVX();
+#endif
+
+// ===scalar===
+
+// plain compares, fminf/fmaxf handle NaN and end up as library calls on some compilers
+static inline float Min(float a, float b) { return a < b ? a : b; }
+static inline float Max(float a, float b) { return a > b ? a : b; }
+
+int RayKernels::RaySpheresScalar(const glm::vec3& orig, const glm::vec3& dir, const float* cx, const float* cy, const float* cz, const float* radius, int count, float tMax, float& t)
+{
+	float a = glm::dot(dir, dir);
+	int best = -1;
+
+	for (int i = 0; i < count; i++)
+	{
+		float ocx = cx[i] - orig.x;
+		float ocy = cy[i] - orig.y;
+		float ocz = cz[i] - orig.z;
+
+		// b is the projection of the origin to center vector on the ray, c > 0 means the ray starts outside
+		float b = ocx * dir.x + ocy * dir.y + ocz * dir.z;
+		float c = ocx * ocx + ocy * ocy + ocz * ocz - radius[i] * radius[i];
+		float disc = b * b - a * c;
+		if (c <= 0.0f || b <= 0.0f || disc < 0.0f)
+			continue;
+
+		float ti = (b - sqrtf(disc)) / a;
+		if (ti < tMax)
+		{
+			tMax = ti;
+			best = i;
+		}
+	}
+
+	if (best >= 0)
+		t = tMax;
+	return best;
+}
+
+int RayKernels::RaySpheresOverlapScalar(const glm::vec3& orig, const glm::vec3& dir, const float* cx, const float* cy, const float* cz, const float* radius, int count, float tMax, float* tNear)
+{
+	float a = glm::dot(dir, dir);
+	int hits = 0;
+
+	for (int i = 0; i < count; i++)
+	{
+		float ocx = cx[i] - orig.x;
+		float ocy = cy[i] - orig.y;
+		float ocz = cz[i] - orig.z;
+
+		float b = ocx * dir.x + ocy * dir.y + ocz * dir.z;
+		float c = ocx * ocx + ocy * ocy + ocz * ocz - radius[i] * radius[i];
+		float disc = b * b - a * c;
+		tNear[i] = FLT_MAX;
+		if (disc < 0.0f)
+			continue;
+
+		// unlike RaySpheres the sphere counts as hit while the ray is inside it, tNear is then negative
+		float sq = sqrtf(disc);
+		float tn = (b - sq) / a;
+		float tf = (b + sq) / a;
+		if (tf > 0.0f && tn < tMax)
+		{
+			tNear[i] = tn;
+			hits++;
+		}
+	}
+	return hits;
+}
+
+int RayKernels::RayBoxesScalar(const glm::vec3& orig, const glm::vec3& invDir, const float* minX, const float* minY, const float* minZ,
+	const float* maxX, const float* maxY, const float* maxZ, int count, float tMax, float* tNear)
+{
+	int hits = 0;
+	for (int i = 0; i < count; i++)
+	{
+		float t1x = (minX[i] - orig.x) * invDir.x, t2x = (maxX[i] - orig.x) * invDir.x;
+		float t1y = (minY[i] - orig.y) * invDir.y, t2y = (maxY[i] - orig.y) * invDir.y;
+		float t1z = (minZ[i] - orig.z) * invDir.z, t2z = (maxZ[i] - orig.z) * invDir.z;
+
+		float tn = Max(Max(Min(t1x, t2x), Min(t1y, t2y)), Min(t1z, t2z));
+		float tf = Min(Min(Max(t1x, t2x), Max(t1y, t2y)), Max(t1z, t2z));
+
+		if (tf >= tn && tf > 0.0f && tn < tMax)
+		{
+			tNear[i] = tn;
+			hits++;
+		}
+		else
+			tNear[i] = FLT_MAX;
+	}
+	return hits;
+}
+
+int RayKernels::RayPacketBoxScalar(const float* ox, const float* oy, const float* oz, const float* invDx, const float* invDy, const float* invDz,
+	int count, const glm::vec3& boxMin, const glm::vec3& boxMax, float tMax, uint8_t* hits)
+{
+	int hitCount = 0;
+	for (int i = 0; i < count; i++)
+	{
+		float t1x = (boxMin.x - ox[i]) * invDx[i], t2x = (boxMax.x - ox[i]) * invDx[i];
+		float t1y = (boxMin.y - oy[i]) * invDy[i], t2y = (boxMax.y - oy[i]) * invDy[i];
+		float t1z = (boxMin.z - oz[i]) * invDz[i], t2z = (boxMax.z - oz[i]) * invDz[i];
+
+		float tn = Max(Max(Min(t1x, t2x), Min(t1y, t2y)), Min(t1z, t2z));
+		float tf = Min(Min(Max(t1x, t2x), Max(t1y, t2y)), Max(t1z, t2z));
+
+		hits[i] = (tf >= tn && tf > 0.0f && tn < tMax) ? 1 : 0;
+		hitCount += hits[i];
+	}
+	return hitCount;
+}
+
+// determinants below this count as a ray parallel to the triangle, hits closer than it as self intersections
+static const float TriangleEpsilon = 1e-7f;
+
+int RayKernels::RayTrianglesScalar(const glm::vec3& orig, const glm::vec3& dir, const float* v0x, const float* v0y, const float* v0z,
+	const float* e1x, const float* e1y, const float* e1z, const float* e2x, const float* e2y, const float* e2z, int count, float tMax, float& t)
+{
+	int best = -1;
+	for (int i = 0; i < count; i++)
+	{
+		glm::vec3 e1(e1x[i], e1y[i], e1z[i]);
+		glm::vec3 e2(e2x[i], e2y[i], e2z[i]);
+
+		glm::vec3 p = glm::cross(dir, e2);
+		float det = glm::dot(e1, p);
+		if (det > -TriangleEpsilon && det < TriangleEpsilon)
+			continue;
+		float invDet = 1.0f / det;
+
+		glm::vec3 tv = orig - glm::vec3(v0x[i], v0y[i], v0z[i]);
+		float u = glm::dot(tv, p) * invDet;
+		if (u < 0.0f || u > 1.0f)
+			continue;
+
+		glm::vec3 q = glm::cross(tv, e1);
+		float v = glm::dot(dir, q) * invDet;
+		if (v < 0.0f || u + v > 1.0f)
+			continue;
+
+		float ti = glm::dot(e2, q) * invDet;
+		if (ti > TriangleEpsilon && ti < tMax)
+		{
+			tMax = ti;
+			best = i;
+		}
+	}
+
+	if (best >= 0)
+		t = tMax;
+	return best;
+}
+
+// ===SSE, 4 lanes===
+#ifdef RAYKERNELS_SSE
+
+static int RayTrianglesSSE(const glm::vec3& orig, const glm::vec3& dir, const float* v0x, const float* v0y, const float* v0z,
+	const float* e1x, const float* e1y, const float* e1z, const float* e2x, const float* e2y, const float* e2z, int count, float& tMax, int& done)
+{
+	const __m128 ox = _mm_set1_ps(orig.x), oy = _mm_set1_ps(orig.y), oz = _mm_set1_ps(orig.z);
+	const __m128 dx = _mm_set1_ps(dir.x), dy = _mm_set1_ps(dir.y), dz = _mm_set1_ps(dir.z);
+	const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+	const __m128 eps = _mm_set1_ps(TriangleEpsilon);
+	const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+
+	int best = -1;
+	int i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 ax = _mm_loadu_ps(e1x + i), ay = _mm_loadu_ps(e1y + i), az = _mm_loadu_ps(e1z + i);
+		__m128 bx = _mm_loadu_ps(e2x + i), by = _mm_loadu_ps(e2y + i), bz = _mm_loadu_ps(e2z + i);
+
+		// p = dir x e2
+		__m128 px = _mm_sub_ps(_mm_mul_ps(dy, bz), _mm_mul_ps(dz, by));
+		__m128 py = _mm_sub_ps(_mm_mul_ps(dz, bx), _mm_mul_ps(dx, bz));
+		__m128 pz = _mm_sub_ps(_mm_mul_ps(dx, by), _mm_mul_ps(dy, bx));
+
+		__m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, px), _mm_mul_ps(ay, py)), _mm_mul_ps(az, pz));
+		__m128 mask = _mm_cmpge_ps(_mm_and_ps(det, absMask), eps);
+		if (_mm_movemask_ps(mask) == 0)
+			continue;
+		__m128 invDet = _mm_div_ps(one, det);
+
+		__m128 tx = _mm_sub_ps(ox, _mm_loadu_ps(v0x + i));
+		__m128 ty = _mm_sub_ps(oy, _mm_loadu_ps(v0y + i));
+		__m128 tz = _mm_sub_ps(oz, _mm_loadu_ps(v0z + i));
+
+		__m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, px), _mm_mul_ps(ty, py)), _mm_mul_ps(tz, pz)), invDet);
+
+		// q = tvec x e1
+		__m128 qx = _mm_sub_ps(_mm_mul_ps(ty, az), _mm_mul_ps(tz, ay));
+		__m128 qy = _mm_sub_ps(_mm_mul_ps(tz, ax), _mm_mul_ps(tx, az));
+		__m128 qz = _mm_sub_ps(_mm_mul_ps(tx, ay), _mm_mul_ps(ty, ax));
+
+		__m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), invDet);
+		__m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(bx, qx), _mm_mul_ps(by, qy)), _mm_mul_ps(bz, qz)), invDet);
+
+		mask = _mm_and_ps(mask, _mm_cmpge_ps(u, zero));
+		mask = _mm_and_ps(mask, _mm_cmpge_ps(v, zero));
+		mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_add_ps(u, v), one));
+		mask = _mm_and_ps(mask, _mm_cmpgt_ps(t, eps));
+		mask = _mm_and_ps(mask, _mm_cmplt_ps(t, _mm_set1_ps(tMax)));
+
+		int bits = _mm_movemask_ps(mask);
+		if (bits == 0)
+			continue;
+
+		float lanes[4];
+		_mm_storeu_ps(lanes, t);
+		for (int k = 0; k < 4; k++)
+		{
+			if ((bits & (1 << k)) && lanes[k] < tMax)
+			{
+				tMax = lanes[k];
+				best = i + k;
+			}
+		}
+	}
+
+	done = i;
+	return best;
+}
+
+static int RaySpheresSSE(const glm::vec3& orig, const glm::vec3& dir, const float* cx, const float* cy, const float* cz, const float* radius, int count, float& tMax)
+{
+	const __m128 ox = _mm_set1_ps(orig.x), oy = _mm_set1_ps(orig.y), oz = _mm_set1_ps(orig.z);
+	const __m128 dx = _mm_set1_ps(dir.x), dy = _mm_set1_ps(dir.y), dz = _mm_set1_ps(dir.z);
+	const float aScalar = glm::dot(dir, dir);
+	const __m128 a = _mm_set1_ps(aScalar);
+	const __m128 zero = _mm_setzero_ps();
+
+	int best = -1;
+	int i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 ocx = _mm_sub_ps(_mm_loadu_ps(cx + i), ox);
+		__m128 ocy = _mm_sub_ps(_mm_loadu_ps(cy + i), oy);
+		__m128 ocz = _mm_sub_ps(_mm_loadu_ps(cz + i), oz);
+		__m128 r = _mm_loadu_ps(radius + i);
+
+		__m128 b = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ocx, dx), _mm_mul_ps(ocy, dy)), _mm_mul_ps(ocz, dz));
+		__m128 c = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ocx, ocx), _mm_mul_ps(ocy, ocy)), _mm_mul_ps(ocz, ocz)), _mm_mul_ps(r, r));
+		__m128 disc = _mm_sub_ps(_mm_mul_ps(b, b), _mm_mul_ps(a, c));
+
+		__m128 mask = _mm_and_ps(_mm_and_ps(_mm_cmpgt_ps(c, zero), _mm_cmpgt_ps(b, zero)), _mm_cmpge_ps(disc, zero));
+		if (_mm_movemask_ps(mask) == 0)
+			continue;
+
+		__m128 t = _mm_div_ps(_mm_sub_ps(b, _mm_sqrt_ps(_mm_max_ps(disc, zero))), a);
+		mask = _mm_and_ps(mask, _mm_cmplt_ps(t, _mm_set1_ps(tMax)));
+
+		int bits = _mm_movemask_ps(mask);
+		if (bits == 0)
+			continue;
+
+		float lanes[4];
+		_mm_storeu_ps(lanes, t);
+		for (int k = 0; k < 4; k++)
+		{
+			if ((bits & (1 << k)) && lanes[k] < tMax)
+			{
+				tMax = lanes[k];
+				best = i + k;
+			}
+		}
+	}
+
+	if (i < count)
+	{
+		float t;
+		int tail = RayKernels::RaySpheresScalar(orig, dir, cx + i, cy + i, cz + i, radius + i, count - i, tMax, t);
+		if (tail >= 0)
+		{
+			tMax = t;
+			best = i + tail;
+		}
+	}
+
+	return best;
+}
+
+static int RaySpheresOverlapSSE(const glm::vec3& orig, const glm::vec3& dir, const float* cx, const float* cy, const float* cz, const float* radius,
+	int count, float tMax, float* tNear, int& done)
+{
+	const __m128 ox = _mm_set1_ps(orig.x), oy = _mm_set1_ps(orig.y), oz = _mm_set1_ps(orig.z);
+	const __m128 dx = _mm_set1_ps(dir.x), dy = _mm_set1_ps(dir.y), dz = _mm_set1_ps(dir.z);
+	const __m128 a = _mm_set1_ps(glm::dot(dir, dir));
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 tm = _mm_set1_ps(tMax);
+	const __m128 miss = _mm_set1_ps(FLT_MAX);
+
+	int hits = 0;
+	int i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 ocx = _mm_sub_ps(_mm_loadu_ps(cx + i), ox);
+		__m128 ocy = _mm_sub_ps(_mm_loadu_ps(cy + i), oy);
+		__m128 ocz = _mm_sub_ps(_mm_loadu_ps(cz + i), oz);
+		__m128 r = _mm_loadu_ps(radius + i);
+
+		__m128 b = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ocx, dx), _mm_mul_ps(ocy, dy)), _mm_mul_ps(ocz, dz));
+		__m128 c = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ocx, ocx), _mm_mul_ps(ocy, ocy)), _mm_mul_ps(ocz, ocz)), _mm_mul_ps(r, r));
+		__m128 disc = _mm_sub_ps(_mm_mul_ps(b, b), _mm_mul_ps(a, c));
+
+		__m128 sq = _mm_sqrt_ps(_mm_max_ps(disc, zero));
+		__m128 tn = _mm_div_ps(_mm_sub_ps(b, sq), a);
+		__m128 tf = _mm_div_ps(_mm_add_ps(b, sq), a);
+
+		__m128 hit = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(disc, zero), _mm_cmpgt_ps(tf, zero)), _mm_cmplt_ps(tn, tm));
+		_mm_storeu_ps(tNear + i, _mm_or_ps(_mm_and_ps(hit, tn), _mm_andnot_ps(hit, miss)));
+
+		int bits = _mm_movemask_ps(hit);
+		hits += (bits & 1) + ((bits >> 1) & 1) + ((bits >> 2) & 1) + ((bits >> 3) & 1);
+	}
+
+	done = i;
+	return hits;
+}
+
+// tNear for the lanes that hit, FLT_MAX for the others
+static inline __m128 SlabSSE(__m128 t1x, __m128 t2x, __m128 t1y, __m128 t2y, __m128 t1z, __m128 t2z, __m128 tMax, int& bits)
+{
+	__m128 tn = _mm_max_ps(_mm_max_ps(_mm_min_ps(t1x, t2x), _mm_min_ps(t1y, t2y)), _mm_min_ps(t1z, t2z));
+	__m128 tf = _mm_min_ps(_mm_min_ps(_mm_max_ps(t1x, t2x), _mm_max_ps(t1y, t2y)), _mm_max_ps(t1z, t2z));
+
+	__m128 hit = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(tf, tn), _mm_cmpgt_ps(tf, _mm_setzero_ps())), _mm_cmplt_ps(tn, tMax));
+	bits = _mm_movemask_ps(hit);
+
+	return _mm_or_ps(_mm_and_ps(hit, tn), _mm_andnot_ps(hit, _mm_set1_ps(FLT_MAX)));
+}
+
+static int RayBoxesSSE(const glm::vec3& orig, const glm::vec3& invDir, const float* minX, const float* minY, const float* minZ,
+	const float* maxX, const float* maxY, const float* maxZ, int count, float tMax, float* tNear, int& done)
+{
+	const __m128 ox = _mm_set1_ps(orig.x), oy = _mm_set1_ps(orig.y), oz = _mm_set1_ps(orig.z);
+	const __m128 ix = _mm_set1_ps(invDir.x), iy = _mm_set1_ps(invDir.y), iz = _mm_set1_ps(invDir.z);
+	const __m128 tm = _mm_set1_ps(tMax);
+
+	int hits = 0;
+	int i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 t1x = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(minX + i), ox), ix);
+		__m128 t2x = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(maxX + i), ox), ix);
+		__m128 t1y = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(minY + i), oy), iy);
+		__m128 t2y = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(maxY + i), oy), iy);
+		__m128 t1z = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(minZ + i), oz), iz);
+		__m128 t2z = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(maxZ + i), oz), iz);
+
+		int bits;
+		_mm_storeu_ps(tNear + i, SlabSSE(t1x, t2x, t1y, t2y, t1z, t2z, tm, bits));
+		hits += (bits & 1) + ((bits >> 1) & 1) + ((bits >> 2) & 1) + ((bits >> 3) & 1);
+	}
+
+	done = i;
+	return hits;
+}
+
+static int RayPacketBoxSSE(const float* ox, const float* oy, const float* oz, const float* invDx, const float* invDy, const float* invDz,
+	int count, const glm::vec3& boxMin, const glm::vec3& boxMax, float tMax, uint8_t* hits, int& done)
+{
+	const __m128 minX = _mm_set1_ps(boxMin.x), minY = _mm_set1_ps(boxMin.y), minZ = _mm_set1_ps(boxMin.z);
+	const __m128 maxX = _mm_set1_ps(boxMax.x), maxY = _mm_set1_ps(boxMax.y), maxZ = _mm_set1_ps(boxMax.z);
+	const __m128 tm = _mm_set1_ps(tMax);
+
+	int hitCount = 0;
+	int i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 rox = _mm_loadu_ps(ox + i), roy = _mm_loadu_ps(oy + i), roz = _mm_loadu_ps(oz + i);
+		__m128 rix = _mm_loadu_ps(invDx + i), riy = _mm_loadu_ps(invDy + i), riz = _mm_loadu_ps(invDz + i);
+
+		__m128 t1x = _mm_mul_ps(_mm_sub_ps(minX, rox), rix);
+		__m128 t2x = _mm_mul_ps(_mm_sub_ps(maxX, rox), rix);
+		__m128 t1y = _mm_mul_ps(_mm_sub_ps(minY, roy), riy);
+		__m128 t2y = _mm_mul_ps(_mm_sub_ps(maxY, roy), riy);
+		__m128 t1z = _mm_mul_ps(_mm_sub_ps(minZ, roz), riz);
+		__m128 t2z = _mm_mul_ps(_mm_sub_ps(maxZ, roz), riz);
+
+		int bits;
+		SlabSSE(t1x, t2x, t1y, t2y, t1z, t2z, tm, bits);
+		for (int k = 0; k < 4; k++)
+		{
+			hits[i + k] = (bits >> k) & 1;
+			hitCount += hits[i + k];
+		}
+	}
+
+	done = i;
+	return hitCount;
+}
+
+#endif
+
+// ===AVX, 8 lanes===
+#ifdef RAYKERNELS_AVX
+
+RAYKERNELS_AVX_TARGET static int RaySpheresAVX(const glm::vec3& orig, const glm::vec3& dir, const float* cx, const float* cy, const float* cz, const float* radius, int count, float& tMax, int& done)
+{
+	const __m256 ox = _mm256_set1_ps(orig.x), oy = _mm256_set1_ps(orig.y), oz = _mm256_set1_ps(orig.z);
+	const __m256 dx = _mm256_set1_ps(dir.x), dy = _mm256_set1_ps(dir.y), dz = _mm256_set1_ps(dir.z);
+	const __m256 a = _mm256_set1_ps(glm::dot(dir, dir));
+	const __m256 zero = _mm256_setzero_ps();
+
+	int best = -1;
+	int i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256 ocx = _mm256_sub_ps(_mm256_loadu_ps(cx + i), ox);
+		__m256 ocy = _mm256_sub_ps(_mm256_loadu_ps(cy + i), oy);
+		__m256 ocz = _mm256_sub_ps(_mm256_loadu_ps(cz + i), oz);
+		__m256 r = _mm256_loadu_ps(radius + i);
+
+		__m256 b = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ocx, dx), _mm256_mul_ps(ocy, dy)), _mm256_mul_ps(ocz, dz));
+		__m256 c = _mm256_sub_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ocx, ocx), _mm256_mul_ps(ocy, ocy)), _mm256_mul_ps(ocz, ocz)), _mm256_mul_ps(r, r));
+		__m256 disc = _mm256_sub_ps(_mm256_mul_ps(b, b), _mm256_mul_ps(a, c));
+
+		__m256 mask = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(c, zero, _CMP_GT_OQ), _mm256_cmp_ps(b, zero, _CMP_GT_OQ)), _mm256_cmp_ps(disc, zero, _CMP_GE_OQ));
+		if (_mm256_movemask_ps(mask) == 0)
+			continue;
+
+		__m256 t = _mm256_div_ps(_mm256_sub_ps(b, _mm256_sqrt_ps(_mm256_max_ps(disc, zero))), a);
+		mask = _mm256_and_ps(mask, _mm256_cmp_ps(t, _mm256_set1_ps(tMax), _CMP_LT_OQ));
+
+		int bits = _mm256_movemask_ps(mask);
+		if (bits == 0)
+			continue;
+
+		float lanes[8];
+		_mm256_storeu_ps(lanes, t);
+		for (int k = 0; k < 8; k++)
+		{
+			if ((bits & (1 << k)) && lanes[k] < tMax)
+			{
+				tMax = lanes[k];
+				best = i + k;
+			}
+		}
+	}
+
+	done = i;
+	return best;
+}
+
+RAYKERNELS_AVX_TARGET static int RaySpheresOverlapAVX(const glm::vec3& orig, const glm::vec3& dir, const float* cx, const float* cy, const float* cz, const float* radius,
+	int count, float tMax, float* tNear, int& done)
+{
+	const __m256 ox = _mm256_set1_ps(orig.x), oy = _mm256_set1_ps(orig.y), oz = _mm256_set1_ps(orig.z);
+	const __m256 dx = _mm256_set1_ps(dir.x), dy = _mm256_set1_ps(dir.y), dz = _mm256_set1_ps(dir.z);
+	const __m256 a = _mm256_set1_ps(glm::dot(dir, dir));
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 tm = _mm256_set1_ps(tMax);
+	const __m256 miss = _mm256_set1_ps(FLT_MAX);
+
+	int hits = 0;
+	int i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256 ocx = _mm256_sub_ps(_mm256_loadu_ps(cx + i), ox);
+		__m256 ocy = _mm256_sub_ps(_mm256_loadu_ps(cy + i), oy);
+		__m256 ocz = _mm256_sub_ps(_mm256_loadu_ps(cz + i), oz);
+		__m256 r = _mm256_loadu_ps(radius + i);
+
+		__m256 b = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ocx, dx), _mm256_mul_ps(ocy, dy)), _mm256_mul_ps(ocz, dz));
+		__m256 c = _mm256_sub_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ocx, ocx), _mm256_mul_ps(ocy, ocy)), _mm256_mul_ps(ocz, ocz)), _mm256_mul_ps(r, r));
+		__m256 disc = _mm256_sub_ps(_mm256_mul_ps(b, b), _mm256_mul_ps(a, c));
+
+		__m256 sq = _mm256_sqrt_ps(_mm256_max_ps(disc, zero));
+		__m256 tn = _mm256_div_ps(_mm256_sub_ps(b, sq), a);
+		__m256 tf = _mm256_div_ps(_mm256_add_ps(b, sq), a);
+
+		__m256 hit = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(disc, zero, _CMP_GE_OQ), _mm256_cmp_ps(tf, zero, _CMP_GT_OQ)), _mm256_cmp_ps(tn, tm, _CMP_LT_OQ));
+		_mm256_storeu_ps(tNear + i, _mm256_blendv_ps(miss, tn, hit));
+
+		int bits = _mm256_movemask_ps(hit);
+		for (int k = 0; k < 8; k++)
+			hits += (bits >> k) & 1;
+	}
+
+	done = i;
+	return hits;
+}
+
+RAYKERNELS_AVX_TARGET static int RayBoxesAVX(const glm::vec3& orig, const glm::vec3& invDir, const float* minX, const float* minY, const float* minZ,
+	const float* maxX, const float* maxY, const float* maxZ, int count, float tMax, float* tNear, int& done)
+{
+	const __m256 ox = _mm256_set1_ps(orig.x), oy = _mm256_set1_ps(orig.y), oz = _mm256_set1_ps(orig.z);
+	const __m256 ix = _mm256_set1_ps(invDir.x), iy = _mm256_set1_ps(invDir.y), iz = _mm256_set1_ps(invDir.z);
+	const __m256 tm = _mm256_set1_ps(tMax);
+	const __m256 miss = _mm256_set1_ps(FLT_MAX);
+
+	int hits = 0;
+	int i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256 t1x = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(minX + i), ox), ix);
+		__m256 t2x = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(maxX + i), ox), ix);
+		__m256 t1y = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(minY + i), oy), iy);
+		__m256 t2y = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(maxY + i), oy), iy);
+		__m256 t1z = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(minZ + i), oz), iz);
+		__m256 t2z = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(maxZ + i), oz), iz);
+
+		__m256 tn = _mm256_max_ps(_mm256_max_ps(_mm256_min_ps(t1x, t2x), _mm256_min_ps(t1y, t2y)), _mm256_min_ps(t1z, t2z));
+		__m256 tf = _mm256_min_ps(_mm256_min_ps(_mm256_max_ps(t1x, t2x), _mm256_max_ps(t1y, t2y)), _mm256_max_ps(t1z, t2z));
+
+		__m256 hit = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(tf, tn, _CMP_GE_OQ), _mm256_cmp_ps(tf, _mm256_setzero_ps(), _CMP_GT_OQ)), _mm256_cmp_ps(tn, tm, _CMP_LT_OQ));
+		_mm256_storeu_ps(tNear + i, _mm256_blendv_ps(miss, tn, hit));
+
+		int bits = _mm256_movemask_ps(hit);
+		for (int k = 0; k < 8; k++)
+			hits += (bits >> k) & 1;
+	}
+
+	done = i;
+	return hits;
+}
+
+#endif
+
+// ===dispatch===
+
+int RayKernels::RaySpheres(const glm::vec3& orig, const glm::vec3& dir, const float* cx, const float* cy, const float* cz, const float* radius, int count, float tMax, float& t)
+{
+	int best = -1;
+	int done = 0;
+
+#ifdef RAYKERNELS_AVX
+	if (hasAVX)
+		best = RaySpheresAVX(orig, dir, cx, cy, cz, radius, count, tMax, done);
+#endif
+
+#ifdef RAYKERNELS_SSE
+	// the SSE kernel finishes its own tail with the scalar one
+	int rest = RaySpheresSSE(orig, dir, cx + done, cy + done, cz + done, radius + done, count - done, tMax);
+	if (rest >= 0)
+		best = done + rest;
+#else
+	float tRest;
+	int rest = RaySpheresScalar(orig, dir, cx, cy, cz, radius, count, tMax, tRest);
+	if (rest >= 0)
+	{
+		best = rest;
+		tMax = tRest;
+	}
+#endif
+
+	if (best >= 0)
+		t = tMax;
+	return best;
+}
+
+int RayKernels::RayBoxes(const glm::vec3& orig, const glm::vec3& invDir, const float* minX, const float* minY, const float* minZ,
+	const float* maxX, const float* maxY, const float* maxZ, int count, float tMax, float* tNear)
+{
+	int hits = 0;
+	int done = 0;
+
+	// every width takes what is left by the wider one, so a few boxes (a BVH node's children) still use SSE on an AVX machine
+#ifdef RAYKERNELS_AVX
+	if (hasAVX)
+		hits += RayBoxesAVX(orig, invDir, minX, minY, minZ, maxX, maxY, maxZ, count, tMax, tNear, done);
+#endif
+#ifdef RAYKERNELS_SSE
+	int doneSSE = 0;
+	hits += RayBoxesSSE(orig, invDir, minX + done, minY + done, minZ + done, maxX + done, maxY + done, maxZ + done, count - done, tMax, tNear + done, doneSSE);
+	done += doneSSE;
+#endif
+
+	hits += RayBoxesScalar(orig, invDir, minX + done, minY + done, minZ + done, maxX + done, maxY + done, maxZ + done, count - done, tMax, tNear + done);
+	return hits;
+}
+
+int RayKernels::RaySpheresOverlap(const glm::vec3& orig, const glm::vec3& dir, const float* cx, const float* cy, const float* cz, const float* radius, int count, float tMax, float* tNear)
+{
+	int hits = 0;
+	int done = 0;
+
+#ifdef RAYKERNELS_AVX
+	if (hasAVX)
+		hits += RaySpheresOverlapAVX(orig, dir, cx, cy, cz, radius, count, tMax, tNear, done);
+#endif
+#ifdef RAYKERNELS_SSE
+	int doneSSE = 0;
+	hits += RaySpheresOverlapSSE(orig, dir, cx + done, cy + done, cz + done, radius + done, count - done, tMax, tNear + done, doneSSE);
+	done += doneSSE;
+#endif
+
+	hits += RaySpheresOverlapScalar(orig, dir, cx + done, cy + done, cz + done, radius + done, count - done, tMax, tNear + done);
+	return hits;
+}
+
+int RayKernels::RayPacketBox(const float* ox, const float* oy, const float* oz, const float* invDx, const float* invDy, const float* invDz,
+	int count, const glm::vec3& boxMin, const glm::vec3& boxMax, float tMax, uint8_t* hits)
+{
+	int hitCount = 0;
+	int done = 0;
+
+#ifdef RAYKERNELS_SSE
+	hitCount += RayPacketBoxSSE(ox, oy, oz, invDx, invDy, invDz, count, boxMin, boxMax, tMax, hits, done);
+#endif
+
+	hitCount += RayPacketBoxScalar(ox + done, oy + done, oz + done, invDx + done, invDy + done, invDz + done, count - done, boxMin, boxMax, tMax, hits + done);
+	return hitCount;
+}
+
+int RayKernels::RayTriangles(const glm::vec3& orig, const glm::vec3& dir, const float* v0x, const float* v0y, const float* v0z,
+	const float* e1x, const float* e1y, const float* e1z, const float* e2x, const float* e2y, const float* e2z, int count, float tMax, float& t)
+{
+	int best = -1;
+	int done = 0;
+
+	// mesh BVH leaves hold up to 4 triangles, one SSE pass covers them
+#ifdef RAYKERNELS_SSE
+	best = RayTrianglesSSE(orig, dir, v0x, v0y, v0z, e1x, e1y, e1z, e2x, e2y, e2z, count, tMax, done);
+#endif
+
+	float tRest;
+	int rest = RayTrianglesScalar(orig, dir, v0x + done, v0y + done, v0z + done, e1x + done, e1y + done, e1z + done,
+		e2x + done, e2y + done, e2z + done, count - done, tMax, tRest);
+	if (rest >= 0)
+	{
+		best = done + rest;
+		tMax = tRest;
+	}
+
+	if (best >= 0)
+		t = tMax;
+	return best;
+}
+
+const char* RayKernels::GetWidthName()
+{
+#ifdef RAYKERNELS_AVX
+	if (hasAVX)
+		return "AVX (8 lanes)";
+#endif
+#ifdef RAYKERNELS_SSE
+	return "SSE (4 lanes)";
+#else
+	return "scalar";
+#endif
+}
+
+// ===benchmark===
+
+static float RandomRange(float lo, float hi)
+{
+	return lo + (hi - lo) * (rand() / (float)RAND_MAX);
+}
+
+template <typename F>
+static double TimeNs(F f)
+{
+	auto start = std::chrono::steady_clock::now();
+	f();
+	return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+void RayKernels::RunBenchmark()
+{
+	const int objectCount = 4096;
+	const int rayCount = 2048;
+
+	srand(1234);
+
+	// a level sized cloud of props and rays fired from around the player height
+	std::vector<float> cx(objectCount), cy(objectCount), cz(objectCount), radius(objectCount);
+	std::vector<float> minX(objectCount), minY(objectCount), minZ(objectCount), maxX(objectCount), maxY(objectCount), maxZ(objectCount);
+	std::vector<BoundingSphere> spheres;
+	std::vector<BoundingBox> boxes;
+	spheres.reserve(objectCount);
+	boxes.reserve(objectCount);
+
+	for (int i = 0; i < objectCount; i++)
+	{
+		glm::vec3 c(RandomRange(-50.0f, 50.0f), RandomRange(-1.0f, 5.0f), RandomRange(-50.0f, 50.0f));
+		float r = RandomRange(0.2f, 1.5f);
+
+		cx[i] = c.x; cy[i] = c.y; cz[i] = c.z; radius[i] = r;
+		minX[i] = c.x - r; minY[i] = c.y - r; minZ[i] = c.z - r;
+		maxX[i] = c.x + r; maxY[i] = c.y + r; maxZ[i] = c.z + r;
+
+		spheres.push_back(BoundingSphere(NULL, c, r));
+
+		BoundingBox box(NULL);
+		box.minPointWorld = c - glm::vec3(r);
+		box.maxPointWorld = c + glm::vec3(r);
+		boxes.push_back(box);
+	}
+
+	std::vector<glm::vec3> origins(rayCount), dirs(rayCount), invDirs(rayCount);
+	std::vector<float> ox(rayCount), oy(rayCount), oz(rayCount), idx(rayCount), idy(rayCount), idz(rayCount);
+	for (int i = 0; i < rayCount; i++)
+	{
+		origins[i] = glm::vec3(RandomRange(-5.0f, 5.0f), 1.0f, RandomRange(-5.0f, 5.0f));
+		dirs[i] = glm::normalize(glm::vec3(RandomRange(-1.0f, 1.0f), RandomRange(-0.2f, 0.2f), RandomRange(-1.0f, 1.0f)));
+		invDirs[i] = glm::vec3(1.0f / dirs[i].x, 1.0f / dirs[i].y, 1.0f / dirs[i].z);
+
+		ox[i] = origins[i].x; oy[i] = origins[i].y; oz[i] = origins[i].z;
+		idx[i] = invDirs[i].x; idy[i] = invDirs[i].y; idz[i] = invDirs[i].z;
+	}
+
+	double tests = (double)objectCount * rayCount;
+	// the checksums keep the compiler from dropping the loops and show that the kernels agree
+	long long checkA = 0, checkB = 0;
+
+	printf("Ray kernel benchmark, %d objects x %d rays, dispatch: %s\n", objectCount, rayCount, GetWidthName());
+
+	Intersection hit;
+	double ns = TimeNs([&]() {
+		for (int r = 0; r < rayCount; r++)
+		{
+			float best = FLT_MAX;
+			int bestIdx = -1;
+			for (int i = 0; i < objectCount; i++)
+			{
+				if (spheres[i].CollidesWithRay(origins[r], dirs[r], hit) && hit.distance < best)
+				{
+					best = hit.distance;
+					bestIdx = i;
+				}
+			}
+			checkA += bestIdx;
+		}
+	});
+	printf("  spheres, BoundingSphere::CollidesWithRay: %7.2f ns/test\n", ns / tests);
+
+	ns = TimeNs([&]() {
+		for (int r = 0; r < rayCount; r++)
+		{
+			float t;
+			checkB += RaySpheresScalar(origins[r], dirs[r], cx.data(), cy.data(), cz.data(), radius.data(), objectCount, FLT_MAX, t);
+		}
+	});
+	printf("  spheres, scalar SoA kernel:               %7.2f ns/test\n", ns / tests);
+
+	long long checkC = 0;
+	ns = TimeNs([&]() {
+		for (int r = 0; r < rayCount; r++)
+		{
+			float t;
+			checkC += RaySpheres(origins[r], dirs[r], cx.data(), cy.data(), cz.data(), radius.data(), objectCount, FLT_MAX, t);
+		}
+	});
+	printf("  spheres, SIMD SoA kernel:                 %7.2f ns/test (closest hits %s)\n", ns / tests, (checkA == checkB && checkB == checkC) ? "match" : "DIFFER");
+
+	std::vector<float> tNear(objectCount);
+	long long boxA = 0, boxB = 0, boxC = 0;
+	ns = TimeNs([&]() {
+		for (int r = 0; r < rayCount; r++)
+		{
+			for (int i = 0; i < objectCount; i++)
+			{
+				if (boxes[i].CollidesWithRay(origins[r], dirs[r], hit))
+					boxA++;
+			}
+		}
+	});
+	printf("  boxes, BoundingBox::CollidesWithRay:      %7.2f ns/test\n", ns / tests);
+
+	ns = TimeNs([&]() {
+		for (int r = 0; r < rayCount; r++)
+			boxB += RayBoxesScalar(origins[r], invDirs[r], minX.data(), minY.data(), minZ.data(), maxX.data(), maxY.data(), maxZ.data(), objectCount, FLT_MAX, tNear.data());
+	});
+	printf("  boxes, scalar SoA kernel:                 %7.2f ns/test\n", ns / tests);
+
+	ns = TimeNs([&]() {
+		for (int r = 0; r < rayCount; r++)
+			boxC += RayBoxes(origins[r], invDirs[r], minX.data(), minY.data(), minZ.data(), maxX.data(), maxY.data(), maxZ.data(), objectCount, FLT_MAX, tNear.data());
+	});
+	// BoundingBox::CollidesWithRay also accepts boxes behind the origin, its count is not comparable
+	printf("  boxes, SIMD SoA kernel:                   %7.2f ns/test (hits %s)\n", ns / tests, boxB == boxC ? "match" : "DIFFER");
+
+	std::vector<uint8_t> hits(rayCount);
+	long long packetA = 0, packetB = 0;
+	ns = TimeNs([&]() {
+		for (int i = 0; i < objectCount; i++)
+			packetA += RayPacketBoxScalar(ox.data(), oy.data(), oz.data(), idx.data(), idy.data(), idz.data(), rayCount, glm::vec3(minX[i], minY[i], minZ[i]), glm::vec3(maxX[i], maxY[i], maxZ[i]), FLT_MAX, hits.data());
+	});
+	printf("  packet vs box, scalar:                    %7.2f ns/test\n", ns / tests);
+
+	ns = TimeNs([&]() {
+		for (int i = 0; i < objectCount; i++)
+			packetB += RayPacketBox(ox.data(), oy.data(), oz.data(), idx.data(), idy.data(), idz.data(), rayCount, glm::vec3(minX[i], minY[i], minZ[i]), glm::vec3(maxX[i], maxY[i], maxZ[i]), FLT_MAX, hits.data());
+	});
+	printf("  packet vs box, SIMD:                      %7.2f ns/test (hits %s)\n", ns / tests, packetA == packetB ? "match" : "DIFFER");
+
+	(void)boxA;
+}
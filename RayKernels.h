@@ -0,0 +1,54 @@
+#pragma once
+#ifndef RAYKERNELS_H
+#define RAYKERNELS_H
+
+#include <glm/glm.hpp>
+#include <stdint.h>
+
+// batched ray intersection kernels over bounds stored as structure of arrays (one array per component)
+// the dispatching entry points use AVX (8 lanes) when the CPU has it (checked once at startup), SSE (4 lanes) otherwise,
+// and finish the remainder that doesn't fill a register with the scalar kernel. The scalar kernels are exposed for comparison
+//
+// the sphere test follows BoundingSphere::CollidesWithRay: rays starting inside a sphere don't hit it
+// and t is in units of dir, the box test follows SceneBVH's slab test and returns the entry distance
+class RayKernels
+{
+public:
+	// closest sphere hit by the ray with t < tMax, returns its index or -1, t receives the ray parameter of the hit
+	static int RaySpheres(const glm::vec3& orig, const glm::vec3& dir, const float* cx, const float* cy, const float* cz, const float* radius, int count, float tMax, float& t);
+
+	// one ray against count spheres, tNear[i] receives the entry distance (negative if the ray starts inside the sphere)
+	// or FLT_MAX if the ray misses it before tMax, returns the number of hits. The broad phase of SceneBVH's leaves
+	static int RaySpheresOverlap(const glm::vec3& orig, const glm::vec3& dir, const float* cx, const float* cy, const float* cz, const float* radius, int count, float tMax, float* tNear);
+
+	// one ray against count boxes, tNear[i] receives the entry distance or FLT_MAX on a miss, returns the number of hits
+	static int RayBoxes(const glm::vec3& orig, const glm::vec3& invDir, const float* minX, const float* minY, const float* minZ,
+		const float* maxX, const float* maxY, const float* maxZ, int count, float tMax, float* tNear);
+
+	// packet mode, count rays (origins and inverse directions as SoA) against one box, hits[i] is 1 if ray i hits
+	static int RayPacketBox(const float* ox, const float* oy, const float* oz, const float* invDx, const float* invDy, const float* invDz,
+		int count, const glm::vec3& boxMin, const glm::vec3& boxMax, float tMax, uint8_t* hits);
+
+	// closest triangle hit (Moller-Trumbore, both sides) with t < tMax, triangles as v0 and the edges e1 = v1 - v0, e2 = v2 - v0
+	// returns its index or -1, t receives the ray parameter of the hit
+	static int RayTriangles(const glm::vec3& orig, const glm::vec3& dir, const float* v0x, const float* v0y, const float* v0z,
+		const float* e1x, const float* e1y, const float* e1z, const float* e2x, const float* e2y, const float* e2z, int count, float tMax, float& t);
+
+	static int RayTrianglesScalar(const glm::vec3& orig, const glm::vec3& dir, const float* v0x, const float* v0y, const float* v0z,
+		const float* e1x, const float* e1y, const float* e1z, const float* e2x, const float* e2y, const float* e2z, int count, float tMax, float& t);
+
+	static int RaySpheresScalar(const glm::vec3& orig, const glm::vec3& dir, const float* cx, const float* cy, const float* cz, const float* radius, int count, float tMax, float& t);
+	static int RaySpheresOverlapScalar(const glm::vec3& orig, const glm::vec3& dir, const float* cx, const float* cy, const float* cz, const float* radius, int count, float tMax, float* tNear);
+	static int RayBoxesScalar(const glm::vec3& orig, const glm::vec3& invDir, const float* minX, const float* minY, const float* minZ,
+		const float* maxX, const float* maxY, const float* maxZ, int count, float tMax, float* tNear);
+	static int RayPacketBoxScalar(const float* ox, const float* oy, const float* oz, const float* invDx, const float* invDy, const float* invDz,
+		int count, const glm::vec3& boxMin, const glm::vec3& boxMax, float tMax, uint8_t* hits);
+
+	// name of the instruction set the dispatching kernels run with on this CPU
+	static const char* GetWidthName();
+
+	// times the kernels against BoundingSphere/BoundingBox::CollidesWithRay and prints the results, run with --bench-rays
+	static void RunBenchmark();
+};
+
+#endif
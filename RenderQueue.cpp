@@ -0,0 +1,286 @@
+#include "RenderQueue.h"
+#include "Profiler.h"
+#include <string.h>
+#include <stddef.h>
+#include <algorithm>
+
+RenderQueue* RenderQueue::queueInstance = 0;
+
+RenderQueue::RenderQueue() : instanceVBO(0), instanceCapacity(0), eye(0.0f)
+{
+	memset(&stats, 0, sizeof(stats));
+}
+
+RenderQueue* RenderQueue::GetInstance()
+{
+	if (!queueInstance)
+		queueInstance = new RenderQueue;
+	return queueInstance;
+}
+
+const RenderQueue::Stats& RenderQueue::GetStats() const
+{
+	return stats;
+}
+
+int RenderQueue::GetPacketCount() const
+{
+	return (int)packets.size();
+}
+
+void RenderQueue::Begin(const glm::vec3& eyePos)
+{
+	eye = eyePos;
+	packets.clear();
+	keys.clear();
+}
+
+uint64_t RenderQueue::MakeKey(const Shader* shader, const Mesh& mesh, int lod, float distanceSq)
+{
+	uint64_t shaderBits = shader->ID & 0xFFF;
+	uint64_t textureBits = mesh.textures.empty() ? 0 : (mesh.textures[0].id & 0xFFFF);
+	uint64_t vaoBits = mesh.VAO & 0xFFFF;
+	// the levels of a mesh share the VAO, keeping them apart lets each level be drawn as one instanced batch
+	uint64_t lodBits = (uint64_t)lod & 0x3;
+
+	// a non negative float compares like its bit pattern, the top 18 bits keep the order close enough for front to back
+	uint32_t distanceBits;
+	memcpy(&distanceBits, &distanceSq, sizeof(distanceBits));
+	uint64_t depthBits = (distanceBits >> 13) & 0x3FFFF;
+
+	return (shaderBits << 52) | (textureBits << 36) | (vaoBits << 20) | (lodBits << 18) | depthBits;
+}
+
+void RenderQueue::Submit(const Shader* shader, const Model& model, const glm::mat4& transform, const glm::mat3* normalMat, int lod)
+{
+	glm::vec3 delta = glm::vec3(transform[3]) - eye;
+	float distanceSq = glm::dot(delta, delta);
+
+	for (size_t i = 0; i < model.meshes.size(); i++)
+	{
+		Packet p;
+		p.shader = shader;
+		p.mesh = &model.meshes[i];
+		// meshes with fewer levels than the model draw their coarsest one
+		p.lod = std::min(lod, p.mesh->GetLodCount() - 1);
+		p.model = transform;
+		p.normalMat = normalMat;
+
+		keys.push_back(MakeKey(shader, model.meshes[i], p.lod, distanceSq));
+		packets.push_back(p);
+	}
+}
+
+// LSD radix sort of the keys, 8 bits per pass, carrying the packet index along
+// passes where every key has the same byte are skipped, with a handful of shaders and textures most of the high bytes are
+void RenderQueue::SortKeys()
+{
+	size_t count = keys.size();
+
+	order.resize(count);
+	keysScratch.resize(count);
+	orderScratch.resize(count);
+	for (size_t i = 0; i < count; i++)
+		order[i] = (uint32_t)i;
+
+	uint32_t histogram[8][256];
+	memset(histogram, 0, sizeof(histogram));
+	for (size_t i = 0; i < count; i++)
+	{
+		uint64_t k = keys[i];
+		for (int pass = 0; pass < 8; pass++)
+			histogram[pass][(k >> (pass * 8)) & 0xFF]++;
+	}
+
+	uint64_t* srcKeys = keys.data();
+	uint32_t* srcOrder = order.data();
+	uint64_t* dstKeys = keysScratch.data();
+	uint32_t* dstOrder = orderScratch.data();
+
+	for (int pass = 0; pass < 8; pass++)
+	{
+		uint32_t* h = histogram[pass];
+		int shift = pass * 8;
+
+		if (h[(srcKeys[0] >> shift) & 0xFF] == count)
+			continue;
+
+		uint32_t offset = 0;
+		for (int b = 0; b < 256; b++)
+		{
+			uint32_t c = h[b];
+			h[b] = offset;
+			offset += c;
+		}
+
+		for (size_t i = 0; i < count; i++)
+		{
+			uint32_t dst = h[(srcKeys[i] >> shift) & 0xFF]++;
+			dstKeys[dst] = srcKeys[i];
+			dstOrder[dst] = srcOrder[i];
+		}
+
+		std::swap(srcKeys, dstKeys);
+		std::swap(srcOrder, dstOrder);
+	}
+
+	// an odd number of passes leaves the result in the scratch buffers
+	if (srcOrder != order.data())
+		order.swap(orderScratch);
+}
+
+// groups the sorted packets into runs of the same mesh, level of detail and shader, runs of instanced shaders get a slice of the instance buffer
+void RenderQueue::BuildBatches()
+{
+	batches.clear();
+	instanceData.clear();
+
+	size_t i = 0;
+	while (i < order.size())
+	{
+		const Packet& first = packets[order[i]];
+
+		Batch b;
+		b.first = (uint32_t)i;
+		b.count = 1;
+		b.instanceOffset = -1;
+
+		if (first.shader->isInstanced())
+		{
+			while (i + b.count < order.size())
+			{
+				const Packet& next = packets[order[i + b.count]];
+				if (next.mesh != first.mesh || next.lod != first.lod || next.shader != first.shader)
+					break;
+				b.count++;
+			}
+
+			b.instanceOffset = (int)instanceData.size();
+			bool needsNormal = first.shader->getInstanceNormalAttrib() >= 0;
+			for (uint32_t j = 0; j < b.count; j++)
+			{
+				const Packet& p = packets[order[i + j]];
+
+				InstanceData inst;
+				inst.model = p.model;
+				inst.normalMat = needsNormal && p.normalMat != NULL ? *p.normalMat : glm::mat3(1.0f);
+				instanceData.push_back(inst);
+			}
+		}
+
+		batches.push_back(b);
+		i += b.count;
+	}
+}
+
+void RenderQueue::UploadInstances()
+{
+	if (instanceData.empty())
+		return;
+
+	if (instanceVBO == 0)
+		glGenBuffers(1, &instanceVBO);
+
+	glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+
+	// orphan the old storage so the driver does not wait for last frame's draws to finish reading it
+	size_t size = instanceData.size() * sizeof(InstanceData);
+	if (size > instanceCapacity)
+		instanceCapacity = size * 2;
+	glBufferData(GL_ARRAY_BUFFER, instanceCapacity, NULL, GL_STREAM_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, size, instanceData.data());
+}
+
+// points the instance attributes of the bound VAO at the batch's slice of the instance buffer
+// GL 3.3 has no base instance, so the offset goes into the attribute pointers instead
+void RenderQueue::BindInstanceAttributes(const Shader* shader, int instanceOffset)
+{
+	glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+
+	size_t base = instanceOffset * sizeof(InstanceData);
+
+	GLint modelLoc = shader->getInstanceModelAttrib();
+	for (int c = 0; c < 4; c++)
+	{
+		glEnableVertexAttribArray(modelLoc + c);
+		glVertexAttribPointer(modelLoc + c, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)(base + offsetof(InstanceData, model) + c * sizeof(glm::vec4)));
+		glVertexAttribDivisor(modelLoc + c, 1);
+	}
+
+	GLint normalLoc = shader->getInstanceNormalAttrib();
+	if (normalLoc >= 0)
+	{
+		for (int c = 0; c < 3; c++)
+		{
+			glEnableVertexAttribArray(normalLoc + c);
+			glVertexAttribPointer(normalLoc + c, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)(base + offsetof(InstanceData, normalMat) + c * sizeof(glm::vec3)));
+			glVertexAttribDivisor(normalLoc + c, 1);
+		}
+	}
+}
+
+void RenderQueue::Flush()
+{
+	PROFILE_ZONE("RenderQueue::Flush");
+
+	memset(&stats, 0, sizeof(stats));
+	if (packets.empty())
+		return;
+
+	SortKeys();
+	BuildBatches();
+	UploadInstances();
+
+	const Shader* currentShader = NULL;
+	const Mesh* currentMaterial = NULL;
+	unsigned int currentVAO = 0;
+
+	for (size_t b = 0; b < batches.size(); b++)
+	{
+		const Batch& batch = batches[b];
+		const Packet& p = packets[order[batch.first]];
+
+		if (p.shader != currentShader)
+		{
+			p.shader->use();
+			currentShader = p.shader;
+			// samplers and material uniforms are per program, they have to be set again
+			currentMaterial = NULL;
+			stats.shaderBinds++;
+		}
+
+		if (currentMaterial == NULL || !p.mesh->SameMaterial(*currentMaterial))
+		{
+			p.mesh->BindMaterial(*p.shader);
+			currentMaterial = p.mesh;
+			stats.materialBinds++;
+		}
+
+		if (p.mesh->VAO != currentVAO)
+		{
+			glBindVertexArray(p.mesh->VAO);
+			currentVAO = p.mesh->VAO;
+			stats.vaoBinds++;
+		}
+
+		if (batch.instanceOffset >= 0)
+		{
+			BindInstanceAttributes(p.shader, batch.instanceOffset);
+			glDrawElementsInstanced(GL_TRIANGLES, p.mesh->GetIndexCount(p.lod), p.mesh->GetIndexType(), p.mesh->GetIndexOffset(p.lod), batch.count);
+			stats.instancedDraws++;
+			stats.instances += batch.count;
+		}
+		else
+		{
+			p.shader->setMat4(Shader::UNIFORM_MODEL, p.model);
+			if (p.normalMat != NULL)
+				p.shader->setMat3(Shader::UNIFORM_NORMAL_MAT, *p.normalMat);
+
+			glDrawElements(GL_TRIANGLES, p.mesh->GetIndexCount(p.lod), p.mesh->GetIndexType(), p.mesh->GetIndexOffset(p.lod));
+		}
+		stats.draws++;
+	}
+
+	glBindVertexArray(0);
+	glActiveTexture(GL_TEXTURE0);
+}
@@ -0,0 +1,104 @@
+#pragma once
+#ifndef RENDERQUEUE_H
+#define RENDERQUEUE_H
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <stdint.h>
+#include "Model.h"
+#include "Shader.h"
+
+// collects the draws of a scene graph traversal instead of issuing them right away
+// every packet gets a 64 bit sort key (shader, texture set, VAO, depth), the packets are radix sorted by key and submitted in order
+// so that program, texture and VAO binds are only issued when they actually change
+//
+// consecutive packets of the same mesh, level of detail and shader are drawn with a single glDrawElementsInstanced when the shader declares
+// the per-instance attributes, the transforms of the whole frame go into one instance buffer:
+//
+//	layout (location = 5) in mat4 instanceModel;		// locations 5-8
+//	layout (location = 9) in mat3 instanceNormalMat;	// optional, locations 9-11
+//
+// shaders without them keep getting the model/normalMat uniforms, one draw per packet
+class RenderQueue
+{
+public:
+	struct Stats
+	{
+		int draws;
+		int shaderBinds;
+		int materialBinds;
+		int vaoBinds;
+		int instancedDraws;
+		int instances;
+	};
+
+	static RenderQueue* GetInstance();
+
+	// starts a new frame, eyePos is used for the front to back depth part of the key
+	void Begin(const glm::vec3& eyePos);
+
+	// queues every mesh of the model, normalMat is uploaded along with transform unless it is NULL
+	// it is not copied and has to stay valid until Flush (the scene graph passes the matrix cached in the TransformNode)
+	// lod picks the level of detail of the meshes, see Mesh::lods
+	void Submit(const Shader* shader, const Model& model, const glm::mat4& transform, const glm::mat3* normalMat, int lod = 0);
+
+	// sorts and draws everything queued since Begin
+	void Flush();
+
+	// packets queued since Begin, lets the scene graph count what a subtree submitted
+	int GetPacketCount() const;
+
+	const Stats& GetStats() const;
+private:
+	RenderQueue();
+
+	struct Packet
+	{
+		const Shader* shader;
+		const Mesh* mesh;
+		int lod;
+		glm::mat4 model;
+		const glm::mat3* normalMat;
+	};
+
+	// layout of the instance buffer, matches the instanceModel/instanceNormalMat attributes
+	struct InstanceData
+	{
+		glm::mat4 model;
+		glm::mat3 normalMat;
+	};
+
+	// a run of sorted packets drawn together, instanceOffset is -1 for packets drawn one by one
+	struct Batch
+	{
+		uint32_t first;
+		uint32_t count;
+		int instanceOffset;
+	};
+
+	// key bits from the top: 12 shader, 16 first texture, 16 VAO, 2 level of detail, 18 depth
+	static uint64_t MakeKey(const Shader* shader, const Mesh& mesh, int lod, float distanceSq);
+	void SortKeys();
+	void BuildBatches();
+	void UploadInstances();
+	void BindInstanceAttributes(const Shader* shader, int instanceOffset);
+
+	// kept across frames, they only grow so the steady state does not allocate
+	std::vector<Packet> packets;
+	std::vector<uint64_t> keys;
+	std::vector<uint32_t> order;
+	std::vector<uint64_t> keysScratch;
+	std::vector<uint32_t> orderScratch;
+	std::vector<Batch> batches;
+	std::vector<InstanceData> instanceData;
+
+	GLuint instanceVBO;
+	size_t instanceCapacity;
+
+	glm::vec3 eye;
+	Stats stats;
+
+	static RenderQueue* queueInstance;
+};
+
+#endif
@@ -0,0 +1,70 @@
+#include "ResourceCache.h"
+#include "AssetLoader.h"
+#include <filesystem>
+#include <algorithm>
+#include <ctype.h>
+
+ResourceCache* ResourceCache::cacheInstance = 0;
+
+ResourceCache::ResourceCache() { }
+
+ResourceCache* ResourceCache::GetInstance()
+{
+	if (!cacheInstance)
+		cacheInstance = new ResourceCache;
+	return cacheInstance;
+}
+
+std::string ResourceCache::CanonicalPath(const std::string& path)
+{
+	std::error_code error;
+	std::filesystem::path canonical = std::filesystem::weakly_canonical(std::filesystem::absolute(path, error), error);
+	std::string key = error ? path : canonical.generic_string();
+
+#ifdef _WIN32
+	std::transform(key.begin(), key.end(), key.begin(), [](unsigned char c) { return (char)tolower(c); });
+#endif
+	return key;
+}
+
+std::shared_ptr<Model> ResourceCache::GetModel(const std::string& path)
+{
+	std::string key = CanonicalPath(path);
+
+	std::shared_ptr<Model> model = models[key].lock();
+	if (model)
+		return model;
+
+	model = std::make_shared<Model>();
+	models[key] = model;
+	AssetLoader::GetInstance()->LoadModelAsync(model, path);
+
+	return model;
+}
+
+std::shared_ptr<TextureResource> ResourceCache::AcquireTexture(const std::string& path)
+{
+	std::string key = CanonicalPath(path);
+
+	std::lock_guard<std::mutex> lock(textureMutex);
+
+	std::shared_ptr<TextureResource> texture = textures[key].lock();
+	if (!texture)
+	{
+		texture = std::make_shared<TextureResource>();
+		textures[key] = texture;
+	}
+	return texture;
+}
+
+std::shared_ptr<TextureResource> ResourceCache::GetTexture(const std::string& path)
+{
+	std::shared_ptr<TextureResource> texture = AcquireTexture(path);
+
+	if (!Headless::IsEnabled())
+	{
+		texture->Decode(path);
+		texture->Upload();
+	}
+	return texture;
+}
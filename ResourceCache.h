@@ -0,0 +1,42 @@
+#pragma once
+#ifndef RESOURCECACHE_H
+#define RESOURCECACHE_H
+
+#include <string>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include "Model.h"
+
+// models and textures shared by everything that loads the same file, keyed by the canonical path
+// the cache only holds weak references, a resource lives as long as some node (or model, for textures) uses it
+// and is loaded again if requested after that
+class ResourceCache
+{
+public:
+	static ResourceCache* GetInstance();
+
+	// the first request for a file starts an AssetLoader import, later ones share the same (possibly still loading) model
+	std::shared_ptr<Model> GetModel(const std::string& path);
+
+	// shared texture of the file, not decoded or uploaded yet (TextureResource::Decode / Upload), safe to call from the loader threads
+	std::shared_ptr<TextureResource> AcquireTexture(const std::string& path);
+
+	// decoded and uploaded shared texture, GL thread only
+	std::shared_ptr<TextureResource> GetTexture(const std::string& path);
+
+	// absolute, normalized path (case folded on Windows), so that different spellings of a file hit the same entry
+	static std::string CanonicalPath(const std::string& path);
+private:
+	ResourceCache();
+
+	std::unordered_map<std::string, std::weak_ptr<Model>> models;
+	std::unordered_map<std::string, std::weak_ptr<TextureResource>> textures;
+
+	// textures are acquired by the loader threads
+	std::mutex textureMutex;
+
+	static ResourceCache* cacheInstance;
+};
+
+#endif
@@ -0,0 +1,212 @@
+#include "SceneBVH.h"
+#include "SceneNode.h"
+#include "TransformHierarchy.h"
+#include "RayKernels.h"
+#include "Model.h"
+#include <float.h>
+#include <limits.h>
+#include <algorithm>
+#include <math.h>
+
+// SceneBVH replaces the linear scene graph walk for ray queries, the bullets query it instead of SceneGraph->TraverseIntersection
+
+SceneBVH::SceneBVH() : refitting(false), topologyChanged(false), cursor(0), exactHits(true) { }
+
+void SceneBVH::SetExactHits(bool exact)
+{
+	exactHits = exact;
+}
+
+bool SceneBVH::GetExactHits() const
+{
+	return exactHits;
+}
+
+bool SceneBVH::IsBuilt() const
+{
+	return tree.IsBuilt();
+}
+
+int SceneBVH::GetPrimitiveCount() const
+{
+	return (int)prims.size();
+}
+
+void SceneBVH::AddPrimitive(const BoundingSphere& worldSphere, const std::vector<SceneNode*>& path, const glm::mat4& world, const Model* model)
+{
+	if (refitting && cursor < prims.size() && prims[cursor].sphere.GetNode() == worldSphere.GetNode())
+	{
+		// same instance as last build, only the transform could have changed
+		prims[cursor].sphere = worldSphere;
+		prims[cursor].world = world;
+	}
+	else
+	{
+		if (refitting)
+		{
+			// the graph changed since the last build, drop the stale tail and rebuild afterwards
+			topologyChanged = true;
+			prims.erase(prims.begin() + cursor, prims.end());
+		}
+		prims.push_back(Primitive(worldSphere, path, world, model));
+	}
+	cursor++;
+}
+
+void SceneBVH::Build(SceneNode* root)
+{
+	TransformHierarchy::GetInstance()->Update(root);
+
+	prims.clear();
+
+	refitting = false;
+	cursor = 0;
+	root->TraverseBounds(glm::mat4(1.0f), this);
+
+	// a leaf the SAH finds cheaper than any split is kept at any size
+	tree.Build((int)prims.size(), SphereBounds(prims), MaxLeafSize, INT_MAX);
+
+	UpdateLeafSpheres();
+}
+
+void SceneBVH::Refit(SceneNode* root)
+{
+	if (!IsBuilt())
+	{
+		Build(root);
+		return;
+	}
+
+	TransformHierarchy::GetInstance()->Update(root);
+
+	refitting = true;
+	topologyChanged = false;
+	cursor = 0;
+	root->TraverseBounds(glm::mat4(1.0f), this);
+	refitting = false;
+
+	if (topologyChanged || cursor != prims.size())
+	{
+		Build(root);
+		return;
+	}
+
+	tree.Refit(SphereBounds(prims));
+
+	UpdateLeafSpheres();
+}
+
+void SceneBVH::UpdateLeafSpheres()
+{
+	size_t count = tree.primIndices.size();
+	leafCenterX.resize(count);
+	leafCenterY.resize(count);
+	leafCenterZ.resize(count);
+	leafRadius.resize(count);
+
+	for (size_t i = 0; i < count; i++)
+	{
+		const BoundingSphere& s = prims[tree.primIndices[i]].sphere;
+		glm::vec3 c = s.GetWorldCenter();
+		leafCenterX[i] = c.x;
+		leafCenterY[i] = c.y;
+		leafCenterZ[i] = c.z;
+		leafRadius[i] = s.GetWorldRadius();
+	}
+}
+
+void SceneBVH::SphereBounds::GetBounds(int prim, glm::vec3& bMin, glm::vec3& bMax) const
+{
+	const BoundingSphere& s = prims[prim].sphere;
+	glm::vec3 r(s.GetWorldRadius());
+	bMin = s.GetWorldCenter() - r;
+	bMax = s.GetWorldCenter() + r;
+}
+
+glm::vec3 SceneBVH::SphereBounds::GetCentroid(int prim) const
+{
+	return prims[prim].sphere.GetWorldCenter();
+}
+
+bool SceneBVH::RaycastPrimitive(int leafSlot, float tEnter, const glm::vec3& orig, const glm::vec3& dir, float tMax, float& t) const
+{
+	// the sphere was already hit by the leaf's RaySpheresOverlap, a ray starting inside it (tEnter < 0) still reaches the mesh
+	const Primitive& prim = prims[tree.primIndices[leafSlot]];
+	if (!exactHits || prim.model == NULL)
+	{
+		// no triangles (player), the sphere is the hit volume, and as in RaySpheres only from the outside
+		if (tEnter <= 0.0f)
+			return false;
+		t = tEnter;
+		return true;
+	}
+
+	// the inverse is only needed for the few primitives the ray actually reaches, so it isn't cached per refit
+	// the local direction is not normalized, that way the local ray parameter equals the world one
+	glm::mat4 invWorld = glm::inverse(prim.world);
+	glm::vec3 localOrig = glm::vec3(invWorld * glm::vec4(orig, 1.0f));
+	glm::vec3 localDir = glm::vec3(invWorld * glm::vec4(dir, 0.0f));
+
+	return prim.model->Raycast(localOrig, localDir, tMax, t);
+}
+
+bool SceneBVH::Raycast(const glm::vec3& orig, const glm::vec3& dir, Intersection& closest)
+{
+	return Raycast(orig, dir, FLT_MAX, NULL, closest, true);
+}
+
+bool SceneBVH::Raycast(const glm::vec3& orig, const glm::vec3& dir, float tMax, const SceneNode* ignore, Intersection& closest, bool withPath)
+{
+	float bestT = tMax;
+	int bestPrim = -1;
+
+	tree.Traverse(orig, dir, bestT, [&](int first, int count, float& tBest)
+	{
+		float t;
+		if (!exactHits && ignore == NULL)
+		{
+			int k = RayKernels::RaySpheres(orig, dir, &leafCenterX[first], &leafCenterY[first], &leafCenterZ[first], &leafRadius[first], count, tBest, t);
+			if (k >= 0)
+			{
+				tBest = t;
+				bestPrim = tree.primIndices[first + k];
+				closest.point = orig + dir * t;
+				closest.distance = t;
+				closest.intersectedNode = prims[bestPrim].sphere.GetNode();
+			}
+			return;
+		}
+
+		// exact mode and shooter masking keep the SIMD broad phase, only the spheres it reports are refined
+		// leaves are usually MaxLeafSize wide, a leaf the SAH refused to split is taken a chunk at a time
+		float tEnter[LeafChunkSize];
+		for (int base = first; base < first + count; base += LeafChunkSize)
+		{
+			int n = std::min(LeafChunkSize, first + count - base);
+			if (RayKernels::RaySpheresOverlap(orig, dir, &leafCenterX[base], &leafCenterY[base], &leafCenterZ[base], &leafRadius[base], n, tBest, tEnter) == 0)
+				continue;
+
+			for (int k = 0; k < n; k++)
+			{
+				// missed lanes are FLT_MAX, the shooter's lane is masked out
+				if (tEnter[k] >= tBest || (ignore != NULL && prims[tree.primIndices[base + k]].sphere.GetNode() == ignore))
+					continue;
+				if (RaycastPrimitive(base + k, tEnter[k], orig, dir, tBest, t))
+				{
+					tBest = t;
+					bestPrim = tree.primIndices[base + k];
+					closest.point = orig + dir * t;
+					closest.distance = t;
+					closest.intersectedNode = prims[bestPrim].sphere.GetNode();
+				}
+			}
+		}
+	});
+
+	if (bestPrim < 0)
+		return false;
+
+	if (withPath)
+		closest.intersectionPath = prims[bestPrim].path;
+	return true;
+}
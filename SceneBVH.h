@@ -0,0 +1,89 @@
+#pragma once
+#ifndef SCENEBVH_H
+#define SCENEBVH_H
+
+#include <glm/glm.hpp>
+#include <vector>
+#include "BoundingObjects.h"
+#include "BVHTree.h"
+
+class SceneNode;
+class Model;
+
+// bounding volume hierarchy over the world space bounding spheres of every ModelNode instance in the scene graph
+// built with the surface area heuristic, refitted in place when transforms change and rebuilt only when the graph topology changes
+class SceneBVH
+{
+public:
+	SceneBVH();
+
+	void Build(SceneNode* root);
+	void Refit(SceneNode* root);
+
+	// called by SceneNode::TraverseBounds for every model instance, the sphere must already be in world space
+	// model (may be NULL) is hit tested against its triangles with world transform in exact mode, otherwise the sphere is the hit volume
+	void AddPrimitive(const BoundingSphere& worldSphere, const std::vector<SceneNode*>& path, const glm::mat4& world, const Model* model);
+
+	// closest hit along the ray with the full intersectionPath, returns false if nothing was hit
+	bool Raycast(const glm::vec3& orig, const glm::vec3& dir, Intersection& closest);
+	// closest hit with t < tMax (in units of dir), ignore is a node whose primitive is skipped (the shooter)
+	// a segment a -> b is Raycast(a, b - a, 1.0f, ...)
+	// intersectionPath is a copy of the stored path, so it is only filled when withPath is set (bullets only need intersectedNode)
+	bool Raycast(const glm::vec3& orig, const glm::vec3& dir, float tMax, const SceneNode* ignore, Intersection& closest, bool withPath = false);
+
+	// exact mode refines every sphere hit against the triangles of the model (per mesh MeshBVH), on by default
+	// with it off the bounding spheres are the hit volumes, as before
+	void SetExactHits(bool exact);
+	bool GetExactHits() const;
+
+	bool IsBuilt() const;
+	int GetPrimitiveCount() const;
+private:
+	struct Primitive
+	{
+		BoundingSphere sphere;
+		std::vector<SceneNode*> path;
+		glm::mat4 world;
+		const Model* model;
+
+		Primitive(const BoundingSphere& s, const std::vector<SceneNode*>& p, const glm::mat4& w, const Model* m) : sphere(s), path(p), world(w), model(m) { }
+	};
+
+	// BVHTree bounds policy, the world sphere of a primitive
+	struct SphereBounds
+	{
+		const std::vector<Primitive>& prims;
+
+		SphereBounds(const std::vector<Primitive>& p) : prims(p) { }
+		void GetBounds(int prim, glm::vec3& bMin, glm::vec3& bMax) const;
+		glm::vec3 GetCentroid(int prim) const;
+	};
+
+	static const int MaxLeafSize = 4;
+	static const int SahBins = 12;
+	// spheres passed to one RaySpheresOverlap call, a full AVX register
+	static const int LeafChunkSize = 8;
+
+	std::vector<Primitive> prims;
+	BVHTree<SahBins> tree;
+
+	// world spheres in tree.primIndices order as separate component arrays, so a leaf is tested with one RayKernels::RaySpheres call
+	std::vector<float> leafCenterX;
+	std::vector<float> leafCenterY;
+	std::vector<float> leafCenterZ;
+	std::vector<float> leafRadius;
+
+	// refit bookkeeping, AddPrimitive overwrites existing primitives in traversal order while refitting
+	bool refitting;
+	bool topologyChanged;
+	size_t cursor;
+
+	bool exactHits;
+
+	void UpdateLeafSpheres();
+	// hit test of one primitive whose sphere the ray enters at tEnter, in exact mode against its triangles
+	// t is the world space ray parameter
+	bool RaycastPrimitive(int leafSlot, float tEnter, const glm::vec3& orig, const glm::vec3& dir, float tMax, float& t) const;
+};
+
+#endif
@@ -1,10 +1,24 @@
 #include "SceneNode.h"
+#include "ResourceCache.h"
 #include "ShaderLibrary.h"
+#include "SceneBVH.h"
+#include "RenderQueue.h"
+#include "TransformHierarchy.h"
+#include <float.h>
 
 SceneNode* SceneGraph = NULL;
 
 std::vector<SceneNode*> SceneNode::intersectPath;
 
+static const glm::mat3 identityNormalMatrix(1.0f);
+uint32_t SceneNode::traversalVersion = 0;
+const glm::mat3* SceneNode::traversalNormalMatrix = &identityNormalMatrix;
+int SceneNode::traversalSlot = -1;
+const Frustum* SceneNode::cullingFrustum = NULL;
+glm::vec3 SceneNode::lodEye(0.0f);
+float SceneNode::lodProjScale = 0.0f;
+SceneNode::SubtreeBounds SceneNode::traversalBounds;
+
 // ===SceneNode===
 SceneNode::SceneNode() : NodeName("") 
 { 
@@ -22,14 +36,91 @@ SceneNode::SceneNode(const std::string& name) : NodeName(name)
 	}
 }
 
+void SceneNode::SetCullingFrustum(const Frustum* frustum)
+{
+	cullingFrustum = frustum;
+}
+
+void SceneNode::SetLodView(const glm::vec3& eye, float projScale)
+{
+	lodEye = eye;
+	lodProjScale = projScale;
+}
+
+void SceneNode::SubtreeBounds::Reset()
+{
+	minPoint = glm::vec3(FLT_MAX);
+	maxPoint = glm::vec3(-FLT_MAX);
+	empty = true;
+	unbounded = false;
+}
+
+void SceneNode::SubtreeBounds::AddSphere(const glm::vec3& center, float radius)
+{
+	minPoint = glm::min(minPoint, center - glm::vec3(radius));
+	maxPoint = glm::max(maxPoint, center + glm::vec3(radius));
+	empty = false;
+}
+
+void SceneNode::SubtreeBounds::Merge(const SubtreeBounds& other)
+{
+	if (!other.empty)
+	{
+		minPoint = glm::min(minPoint, other.minPoint);
+		maxPoint = glm::max(maxPoint, other.maxPoint);
+		empty = false;
+	}
+	unbounded = unbounded || other.unbounded;
+}
+
 // ===GroupNode===
-GroupNode::GroupNode() : SceneNode() { } 
+GroupNode::GroupNode() : SceneNode(), boundsMin(0.0f), boundsMax(0.0f), boundsValid(false) { } 
+
+GroupNode::GroupNode(const std::string& name) : SceneNode(name), boundsMin(0.0f), boundsMax(0.0f), boundsValid(false) { }
+
+GroupNode::~GroupNode()
+{
+	// the occlusion query lives as long as the node
+	OcclusionCuller::GetInstance()->Release(occlusion);
+}
+
+bool GroupNode::IsCulled()
+{
+	// until the first TraverseBounds there are no bounds to test against
+	if (cullingFrustum == NULL || !boundsValid)
+		return false;
+
+	if (!cullingFrustum->IntersectsBox(boundsMin, boundsMax))
+	{
+		OcclusionCuller::GetInstance()->Reset(occlusion);
+		return true;
+	}
+
+	return OcclusionCuller::GetInstance()->IsOccluded(occlusion, boundsMin, boundsMax);
+}
+
+void GroupNode::BeginSubtreeBounds(SubtreeBounds& saved)
+{
+	saved = traversalBounds;
+	traversalBounds.Reset();
+}
 
-GroupNode::GroupNode(const std::string& name) : SceneNode(name) { }
+void GroupNode::EndSubtreeBounds(const SubtreeBounds& saved)
+{
+	boundsMin = traversalBounds.minPoint;
+	boundsMax = traversalBounds.maxPoint;
+	boundsValid = !traversalBounds.empty && !traversalBounds.unbounded;
+
+	// hand the subtree up to the parent group
+	SubtreeBounds subtree = traversalBounds;
+	traversalBounds = saved;
+	traversalBounds.Merge(subtree);
+}
 
 void GroupNode::AddNode(SceneNode* sn)
 {
 	groups.push_back(sn);
+	TransformHierarchy::GetInstance()->MarkTopologyChanged();
 }
 
 void GroupNode::RemoveNode(SceneNode* sn)
@@ -45,14 +136,22 @@ void GroupNode::RemoveNode(SceneNode* sn)
 			++it;
 		}
 	}
+	TransformHierarchy::GetInstance()->MarkTopologyChanged();
 }
 
 void GroupNode::Visualize(const glm::mat4& transform) // override
 {
+	if (IsCulled())
+		return;
+
+	int queued = RenderQueue::GetInstance()->GetPacketCount();
+
 	for (auto it = groups.begin(); it != groups.end(); ++it)
 	{
 		(*it)->Visualize(transform);
 	}
+
+	occlusion.lastDrawCount = RenderQueue::GetInstance()->GetPacketCount() - queued;
 }
 
 void GroupNode::TraverseIntersection(const glm::vec3& orig, const glm::vec3& dir, std::vector<Intersection*>& hits) // override
@@ -65,48 +164,133 @@ void GroupNode::TraverseIntersection(const glm::vec3& orig, const glm::vec3& dir
 	intersectPath.pop_back();
 }
 
+void GroupNode::TraverseTransforms(int parentSlot, TransformHierarchy& hierarchy) // override
+{
+	for (auto it = groups.begin(); it != groups.end(); ++it)
+	{
+		(*it)->TraverseTransforms(parentSlot, hierarchy);
+	}
+}
+
+void GroupNode::TraverseBounds(const glm::mat4& transform, SceneBVH* bvh) // override
+{
+	SubtreeBounds saved;
+	BeginSubtreeBounds(saved);
+
+	intersectPath.push_back(this);
+	for (auto it = groups.begin(); it != groups.end(); ++it)
+	{
+		(*it)->TraverseBounds(transform, bvh);
+	}
+	intersectPath.pop_back();
+
+	EndSubtreeBounds(saved);
+}
+
 // ===TransformNode===
 TransformNode::TransformNode()
 {
-	//transform = glm::mat4(1.0f); 
-	rotateVector = glm::vec3(0.0f);
-	rotateVector2 = glm::vec3(0.0f);
-	scaleVector = glm::vec3(1.0f);
-	translateVector = glm::vec3(0.0f);
-	rotateAngleRad = 0.0f;
-	rotateAngleRad2 = 0.0f;
-
+	slot = TransformHierarchy::GetInstance()->Add(this);
 }
 
 TransformNode::TransformNode(const std::string& tr) : GroupNode(tr)
 {
-	//transform = glm::mat4(1.0f);
-	rotateVector = glm::vec3(0.0f);
-	rotateVector2 = glm::vec3(0.0f);
-	scaleVector = glm::vec3(1.0f);
-	translateVector = glm::vec3(0.0f);
-	rotateAngleRad = 0.0f;
-	rotateAngleRad2 = 0.0f;
+	slot = TransformHierarchy::GetInstance()->Add(this);
+}
+
+TransformNode::~TransformNode()
+{
+	// the hierarchy must not keep a pointer to the node, its next rebuild would renumber freed memory
+	TransformHierarchy::GetInstance()->Remove(slot);
+}
+
+void TransformNode::SetTranslation(const glm::vec3& trV)
+{
+	TransformHierarchy::GetInstance()->SetTranslation(slot, trV);
+}
+
+void TransformNode::SetScale(const glm::vec3& scV)
+{
+	TransformHierarchy::GetInstance()->SetScale(slot, scV);
+}
+
+void TransformNode::SetRotation(const glm::vec3& rotV, float angle)
+{
+	TransformHierarchy::GetInstance()->SetRotation(slot, rotV, angle);
+}
+
+void TransformNode::SetRotation2(const glm::vec3& rotV, float angle)
+{
+	TransformHierarchy::GetInstance()->SetRotation2(slot, rotV, angle);
+}
+
+void TransformNode::SetRotationAngle(float angle)
+{
+	TransformHierarchy::GetInstance()->SetRotationAngle(slot, angle);
+}
+
+const glm::vec3& TransformNode::GetTranslation() const
+{
+	return TransformHierarchy::GetInstance()->GetTranslation(slot);
+}
+
+float TransformNode::GetRotationAngle() const
+{
+	return TransformHierarchy::GetInstance()->GetRotationAngle(slot);
+}
+
+int TransformNode::GetSlot() const
+{
+	return slot;
+}
+
+void TransformNode::SetSlot(int s)
+{
+	slot = s;
+}
+
+void TransformNode::PushTraversal(uint32_t& savedVersion, const glm::mat3*& savedNormal, int& savedSlot) const
+{
+	const TransformHierarchy* hierarchy = TransformHierarchy::GetInstance();
+
+	savedVersion = traversalVersion;
+	savedNormal = traversalNormalMatrix;
+	savedSlot = traversalSlot;
+	traversalVersion = hierarchy->GetVersion(slot);
+	traversalNormalMatrix = &hierarchy->GetNormalMatrix(slot);
+	traversalSlot = slot;
+}
+
+void TransformNode::PopTraversal(uint32_t savedVersion, const glm::mat3* savedNormal, int savedSlot)
+{
+	traversalVersion = savedVersion;
+	traversalNormalMatrix = savedNormal;
+	traversalSlot = savedSlot;
 }
 
 void TransformNode::Visualize(const glm::mat4& transform) // override
 {
-	// stack matrices
-	glm::mat4 localTransform = glm::mat4(1.0f);
+	// the world matrix was brought up to date by TransformHierarchy::Update before the traversal
+	if (IsCulled())
+		return;
 
-	localTransform = glm::translate(localTransform, translateVector);
-	if (rotateAngleRad2 != 0.0f)
-		localTransform = glm::rotate(localTransform, rotateAngleRad2, rotateVector2);
-	if (rotateAngleRad != 0.0f)
-		localTransform = glm::rotate(localTransform, rotateAngleRad, rotateVector);
-	localTransform = glm::scale(localTransform, scaleVector);
+	const glm::mat4& worldTransform = TransformHierarchy::GetInstance()->GetWorld(slot);
 
-	glm::mat4 stackedTr = localTransform * transform;
+	uint32_t savedVersion;
+	const glm::mat3* savedNormal;
+	int savedSlot;
+	PushTraversal(savedVersion, savedNormal, savedSlot);
+
+	int queued = RenderQueue::GetInstance()->GetPacketCount();
 
 	for (auto it = groups.begin(); it != groups.end(); ++it)
 	{
-		(*it)->Visualize(stackedTr);
+		(*it)->Visualize(worldTransform);
 	}
+
+	occlusion.lastDrawCount = RenderQueue::GetInstance()->GetPacketCount() - queued;
+
+	PopTraversal(savedVersion, savedNormal, savedSlot);
 }
 
 void TransformNode::TraverseIntersection(const glm::vec3& orig, const glm::vec3& dir, std::vector<Intersection*>& hits) // override
@@ -119,6 +303,41 @@ void TransformNode::TraverseIntersection(const glm::vec3& orig, const glm::vec3&
 	intersectPath.pop_back();
 }
 
+void TransformNode::TraverseTransforms(int parentSlot, TransformHierarchy& hierarchy) // override
+{
+	int newSlot = hierarchy.Visit(this, parentSlot);
+	if (newSlot < 0)
+		return;
+
+	for (auto it = groups.begin(); it != groups.end(); ++it)
+	{
+		(*it)->TraverseTransforms(newSlot, hierarchy);
+	}
+}
+
+void TransformNode::TraverseBounds(const glm::mat4& transform, SceneBVH* bvh) // override
+{
+	const glm::mat4& worldTransform = TransformHierarchy::GetInstance()->GetWorld(slot);
+
+	uint32_t savedVersion;
+	const glm::mat3* savedNormal;
+	int savedSlot;
+	PushTraversal(savedVersion, savedNormal, savedSlot);
+
+	SubtreeBounds saved;
+	BeginSubtreeBounds(saved);
+
+	intersectPath.push_back(this);
+	for (auto it = groups.begin(); it != groups.end(); ++it)
+	{
+		(*it)->TraverseBounds(worldTransform, bvh);
+	}
+	intersectPath.pop_back();
+
+	EndSubtreeBounds(saved);
+	PopTraversal(savedVersion, savedNormal, savedSlot);
+}
+
 // ===ModelNode===
 ModelNode::ModelNode() : SceneNode() { }
 
@@ -148,36 +367,80 @@ void ModelNode::AutoLoadShader(const std::string& name)
 	this->sdr = ShaderLibrary::GetInstance()->GetShader(name);
 }
 
-void ModelNode::SetTexture(const std::string& path)
+void ModelNode::LoadModelFromFile(const std::string& path)
 {
-	Texture tex;
-	GLuint texid;
-	m.LoadTexture(path.c_str(), texid);
-	tex.id = texid;
-	tex.type = "material.texture_diffuse";
-	tex.path = path;
+	// imported in the background (once for all nodes using the file), the sphere is created by TraverseBounds once the model is ready
+	loading = true;
+	m = ResourceCache::GetInstance()->GetModel(path);
+}
 
-	m.textures_loaded.push_back(tex);
+void ModelNode::Visualize(const glm::mat4& transform)
+{
+	// still loading (or nothing loaded)
+	if (sphere == NULL)
+		return;
+
+	InstanceState& instance = GetInstanceState(transform);
 
+	if (cullingFrustum != NULL && !cullingFrustum->IntersectsSphere(instance.center, instance.radius))
+		return;
+
+	// drawn when the render queue is flushed, sorted by shader and material
+	RenderQueue::GetInstance()->Submit(sdr, *m, transform, traversalNormalMatrix, SelectLod(instance));
 }
 
-void ModelNode::LoadModelFromFile(const std::string& path)
+ModelNode::InstanceState& ModelNode::GetInstanceState(const glm::mat4& transform)
 {
-	m.LoadModel(path);
-	// create sphere
-	sphere = new BoundingSphere(this, m);
-	//box = new BoundingBox(this, m);
+	// only allocates the first time an instance is drawn
+	auto it = instances.find(traversalSlot);
+	if (it == instances.end())
+	{
+		InstanceState state;
+		state.version = 0xFFFFFFFF;
+		state.lod = 0;
+		it = instances.emplace(traversalSlot, state).first;
+	}
+
+	// nothing above the instance moved since the last call, the sphere is still valid
+	// slots renumbered by a topology change carry their versions along, a stale entry never matches
+	InstanceState& instance = it->second;
+	if (instance.version != traversalVersion)
+	{
+		BoundingSphere worldSphere = *sphere;
+		worldSphere.Transform(transform);
+		instance.center = worldSphere.GetWorldCenter();
+		instance.radius = worldSphere.GetWorldRadius();
+		instance.version = traversalVersion;
+	}
+	return instance;
 }
 
-void ModelNode::Visualize(const glm::mat4& transform)
+// a zombie (radius about 1) switches at roughly 10, 20 and 40 units with the default 45 degree field of view
+const float ModelNode::LodScreenSize[Mesh::MaxLods - 1] = { 0.25f, 0.12f, 0.06f };
+
+int ModelNode::SelectLod(InstanceState& instance)
 {
-	sdr->use();
-	sdr->setMat4("model", transform);
-	glm::mat3 normalMat = glm::transpose(glm::inverse(transform));
-	sdr->setMat3("normalMat", normalMat);
-	sphere->Transform(transform); // compromise, assume transform will not change when traversing for intersect since last visualize call
-	//box->Transform(transform);
-	m.Draw(*sdr);
+	int lodCount = m->GetLodCount();
+	float radius = instance.radius;
+	float distance = glm::length(instance.center - lodEye);
+
+	if (lodCount <= 1 || lodProjScale <= 0.0f || distance <= radius)
+	{
+		instance.lod = 0;
+		return instance.lod;
+	}
+
+	float size = radius * lodProjScale / distance;
+
+	// coarser once the size is clearly below the next switch point, finer once it is clearly above the current one
+	if (instance.lod >= lodCount)
+		instance.lod = lodCount - 1;
+	while (instance.lod + 1 < lodCount && size < LodScreenSize[instance.lod] * (1.0f - LodHysteresis))
+		instance.lod++;
+	while (instance.lod > 0 && size > LodScreenSize[instance.lod - 1] * (1.0f + LodHysteresis))
+		instance.lod--;
+
+	return instance.lod;
 }
 
 void ModelNode::TraverseIntersection(const glm::vec3& orig, const glm::vec3& dir, std::vector<Intersection*>& hits)
@@ -199,3 +462,40 @@ void ModelNode::TraverseIntersection(const glm::vec3& orig, const glm::vec3& dir
 	else
 		delete hit;
 }
+
+
+void ModelNode::TraverseBounds(const glm::mat4& transform, SceneBVH* bvh)
+{
+	if (loading)
+	{
+		// a placeholder has nothing to hit and doesn't widen the group bounds, the BVH is rebuilt once it shows up
+		if (!m->IsReady())
+			return;
+
+		loading = false;
+		if (!m->meshes.empty())
+			sphere = new BoundingSphere(this, *m);
+		//box = new BoundingBox(this, *m);
+	}
+
+	if (sphere == NULL)
+	{
+		// drawn without a bounding volume (terrain), the groups above it can't be culled
+		traversalBounds.unbounded = true;
+		return;
+	}
+
+	// the same ModelNode can hang under several transforms (crates), so every instance gets its own world sphere
+	const InstanceState& instance = GetInstanceState(transform);
+	traversalBounds.AddSphere(instance.center, instance.radius);
+
+	if (bvh == NULL)
+		return;
+
+	// the BVH only reads the world center and radius, take the ones GetInstanceState already cached for this transform
+	BoundingSphere worldSphere(this, instance.center, instance.radius);
+
+	intersectPath.push_back(this);
+	bvh->AddPrimitive(worldSphere, intersectPath, transform, m.get());
+	intersectPath.pop_back();
+}
\ No newline at end of file
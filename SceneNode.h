@@ -5,22 +5,64 @@
 
 #include <glm/glm.hpp>
 #include <vector>
+#include <stdint.h>
+#include <memory>
+#include <unordered_map>
 #include "Model.h"
 #include "Shader.h"
 #include "BoundingObjects.h"
+#include "OcclusionCuller.h"
+
+class SceneBVH;
+class TransformHierarchy;
 
 class SceneNode
 {
 public:
 	SceneNode();
 	SceneNode(const std::string& name);
+	virtual ~SceneNode() { }
 
 	virtual void Visualize(const glm::mat4& transform) = 0;
 	virtual void TraverseIntersection(const glm::vec3& orig, const glm::vec3& dir, std::vector<Intersection*>& hits) = 0;
+	// refreshes the group bounds and adds every model instance to bvh, NULL only refreshes the bounds (before culling a frame)
+	virtual void TraverseBounds(const glm::mat4& transform, SceneBVH* bvh) = 0;
+	// walks down to the TransformNodes so TransformHierarchy can sort them parents first, parentSlot is the closest one above
+	virtual void TraverseTransforms(int parentSlot, TransformHierarchy& hierarchy) { }
 
 	const std::string NodeName;
+
+	// frustum used to cull the next Visualize traversals, NULL draws everything
+	static void SetCullingFrustum(const Frustum* frustum);
+	// camera the next Visualize traversals pick levels of detail for, projScale is proj[1][1] (0 draws full detail)
+	static void SetLodView(const glm::vec3& eye, float projScale);
 protected:
 	static std::vector<SceneNode*> intersectPath;
+	static const Frustum* cullingFrustum;
+	static glm::vec3 lodEye;
+	static float lodProjScale;
+
+	// world space box of everything below the node being traversed by TraverseBounds
+	struct SubtreeBounds
+	{
+		glm::vec3 minPoint;
+		glm::vec3 maxPoint;
+		bool empty;
+		// something below has no bounds (terrain) and has to be drawn regardless
+		bool unbounded;
+
+		void Reset();
+		void AddSphere(const glm::vec3& center, float radius);
+		void Merge(const SubtreeBounds& other);
+	};
+	static SubtreeBounds traversalBounds;
+
+	// world matrix version and normal matrix of the closest TransformNode above the node being traversed
+	// version 0 is the root (identity), nodes compare versions to skip matrix work when nothing above them moved
+	static uint32_t traversalVersion;
+	static const glm::mat3* traversalNormalMatrix;
+	// TransformHierarchy slot of that TransformNode, -1 at the root, tells apart the instances of a shared node
+	static int traversalSlot;
 };
 
 extern SceneNode* SceneGraph;
@@ -30,40 +72,64 @@ class GroupNode : public SceneNode
 public:
 	GroupNode();
 	GroupNode(const std::string& name);
+	~GroupNode();
 
 	void AddNode(SceneNode* sn);
 	void RemoveNode(SceneNode* sn);
 
 	void Visualize(const glm::mat4& transform); // override
 	void TraverseIntersection(const glm::vec3& orig, const glm::vec3& dir, std::vector<Intersection*>& hits); // override
+	void TraverseBounds(const glm::mat4& transform, SceneBVH* bvh); // override
+	void TraverseTransforms(int parentSlot, TransformHierarchy& hierarchy); // override
 protected:
 	std::vector<SceneNode*> groups;
+
+	// bounds of the whole subtree, refreshed on every TraverseBounds (the BVH refit each tick, and every frame at the interpolated pose)
+	// so that Visualize can reject the subtree with a single test without visiting it
+	glm::vec3 boundsMin;
+	glm::vec3 boundsMax;
+	bool boundsValid;
+
+	OcclusionState occlusion;
+
+	// frustum and occlusion test of the whole subtree, only during Visualize
+	bool IsCulled();
+	void BeginSubtreeBounds(SubtreeBounds& saved);
+	void EndSubtreeBounds(const SubtreeBounds& saved);
 };
 
+// handle to a slot of the TransformHierarchy, which owns the TRS values and the cached local/world/normal matrices
 class TransformNode : public GroupNode
 {
 public:
-	glm::vec3 rotateVector;
-	glm::vec3 rotateVector2;
-	glm::vec3 scaleVector;
-	glm::vec3 translateVector;
-	float rotateAngleRad;
-	float rotateAngleRad2;
-
 	TransformNode();
 	TransformNode(const std::string& name);
+	~TransformNode();
 
-	//void Rotate(glm::vec3 rotV, float angle);
-	//void Scale(glm::vec3 scV);
-	//void Translate(glm::vec3 trV);
+	// setters mark the slot dirty, only changed values invalidate the cached matrices
+	void SetTranslation(const glm::vec3& trV);
+	void SetScale(const glm::vec3& scV);
+	void SetRotation(const glm::vec3& rotV, float angle);
+	void SetRotation2(const glm::vec3& rotV, float angle);
+	void SetRotationAngle(float angle);
 
-	//void SetTransform(glm::mat4 tr);
-	//glm::mat4 GetTransform();
+	const glm::vec3& GetTranslation() const;
+	float GetRotationAngle() const;
+
+	int GetSlot() const;
+	// only TransformHierarchy moves slots around
+	void SetSlot(int s);
 
 	void Visualize(const glm::mat4& transform); // override
 	void TraverseIntersection(const glm::vec3& orig, const glm::vec3& dir, std::vector<Intersection*>& hits); // override
+	void TraverseBounds(const glm::mat4& transform, SceneBVH* bvh); // override
+	void TraverseTransforms(int parentSlot, TransformHierarchy& hierarchy); // override
 private:
-	//glm::mat4 transform;
+	int slot;
+
+	// makes this node the current parent for the traversal of its children, returns the state to restore afterwards
+	void PushTraversal(uint32_t& savedVersion, const glm::mat3*& savedNormal, int& savedSlot) const;
+	static void PopTraversal(uint32_t savedVersion, const glm::mat3* savedNormal, int savedSlot);
 };
 
 class ModelNode : public SceneNode
@@ -79,13 +145,37 @@ public:
 
 	void Visualize(const glm::mat4& transform); // override
 	void TraverseIntersection(const glm::vec3& orig, const glm::vec3& dir, std::vector<Intersection*>& hits); // override
+	void TraverseBounds(const glm::mat4& transform, SceneBVH* bvh); // override
 	void LoadModelFromFile(const std::string& path);
-	void SetTexture(const std::string& path);
 
 protected:
-	Model m;
+	// shared with every node that loaded the same file, see ResourceCache
+	std::shared_ptr<Model> m = std::make_shared<Model>();
 	Shader* sdr;
+	// model space sphere, every instance keeps its own world space copy in instances
 	BoundingSphere* sphere = NULL;
+	// m is still being loaded by the AssetLoader, the node draws and bounds nothing until it is ready
+	bool loading = false;
+
+	// projected radius (in half screen heights) below which level i + 1 is drawn, and the margin around each switch point
+	static const float LodScreenSize[Mesh::MaxLods - 1];
+	static constexpr float LodHysteresis = 0.15f;
+
+	// world sphere of every place the node is drawn, keyed by traversalSlot (the repos share one node under many transforms)
+	// only recomputed when the transform above the instance moved, static geometry costs no matrix math
+	struct InstanceState
+	{
+		// traversalVersion the sphere was transformed with
+		uint32_t version;
+		glm::vec3 center;
+		float radius;
+		// level of detail drawn last frame, the switch points depend on it so that an instance doesn't flicker between two levels
+		int lod;
+	};
+	std::unordered_map<int, InstanceState> instances;
+
+	InstanceState& GetInstanceState(const glm::mat4& transform);
+	int SelectLod(InstanceState& instance);
 	//BoundingBox* box = NULL;
 private:
 	
@@ -9,12 +9,42 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
 
 #include "GLErrorLogger.h"
 
 class Shader
 {
 public:
+	// uniforms used on the per-draw paths, their locations are resolved once at link time
+	// so setting them is a plain array lookup with no string handling
+	enum UniformId
+	{
+		UNIFORM_MODEL,
+		UNIFORM_NORMAL_MAT,
+		UNIFORM_PROJ,
+		UNIFORM_VIEW,
+		UNIFORM_VIEW_POS,
+		UNIFORM_LIGHT_DIFFUSE,
+		UNIFORM_LIGHT_POSITION,
+		UNIFORM_MATERIAL_SHININESS,
+		UNIFORM_MATERIAL_SPECULAR_SET,
+		UNIFORM_COLOR,
+		UNIFORM_ORTHO,
+		UNIFORM_RENDER_OFFSET,
+		UNIFORM_TEXT_DIFFUSE,
+		// material.texture_<type>N samplers, MaxMaterialTextures consecutive entries per type
+		UNIFORM_TEXTURE_DIFFUSE,
+		UNIFORM_TEXTURE_SPECULAR = UNIFORM_TEXTURE_DIFFUSE + 4,
+		UNIFORM_TEXTURE_NORMAL = UNIFORM_TEXTURE_SPECULAR + 4,
+		UNIFORM_TEXTURE_HEIGHT = UNIFORM_TEXTURE_NORMAL + 4,
+		UNIFORM_COUNT = UNIFORM_TEXTURE_HEIGHT + 4
+	};
+
+	static const int MaxMaterialTextures = 4;
+
 	unsigned int ID;
 	std::string Name;
 	// constructor generates the shader on the fly
@@ -23,11 +53,17 @@ public:
 	{
 		ID = 0;
 		Name = "";
+		std::fill(uniformLocations, uniformLocations + UNIFORM_COUNT, -1);
+		instanceModelAttrib = -1;
+		instanceNormalAttrib = -1;
 	}
 
 	Shader(const std::string& n)
 	{
 		Name = n;
+		std::fill(uniformLocations, uniformLocations + UNIFORM_COUNT, -1);
+		instanceModelAttrib = -1;
+		instanceNormalAttrib = -1;
 	}
 
 
@@ -73,8 +109,12 @@ public:
 		{
 			std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
 		}
-		const char* vShaderCode = vertexCode.c_str();
-		const char* fShaderCode = fragmentCode.c_str();
+		Compile(vertexCode.c_str(), fragmentCode.c_str(), geometryPath != nullptr ? geometryCode.c_str() : nullptr);
+	}
+
+	// builds the program from source already in memory, used by Load and by the engine's built-in shaders
+	void Compile(const char* vShaderCode, const char* fShaderCode, const char* gShaderCode = nullptr)
+	{
 		// 2. compile shaders
 		unsigned int vertex, fragment;
 		int success;
@@ -91,9 +131,8 @@ public:
 		checkCompileErrors(fragment, "FRAGMENT");
 		// if geometry shader is given, compile geometry shader
 		unsigned int geometry;
-		if (geometryPath != nullptr)
+		if (gShaderCode != nullptr)
 		{
-			const char* gShaderCode = geometryCode.c_str();
 			geometry = glCreateShader(GL_GEOMETRY_SHADER);
 			glShaderSource(geometry, 1, &gShaderCode, NULL);
 			glCompileShader(geometry);
@@ -103,29 +142,102 @@ public:
 		ID = glCreateProgram();
 		glAttachShader(ID, vertex);
 		glAttachShader(ID, fragment);
-		if (geometryPath != nullptr)
+		if (gShaderCode != nullptr)
 			glAttachShader(ID, geometry);
 		glLinkProgram(ID);
 		checkCompileErrors(ID, "PROGRAM");
 		// delete the shaders as they're linked into our program now and no longer necessery
 		glDeleteShader(vertex);
 		glDeleteShader(fragment);
-		if (geometryPath != nullptr)
+		if (gShaderCode != nullptr)
 			glDeleteShader(geometry);
 
+		cacheUniforms();
 	}
 
 	// activate the shader
 	// ------------------------------------------------------------------------
-	void use()
+	void use() const
 	{
 		glUseProgram(ID);
 	}
+	// cached uniform locations
+	// ------------------------------------------------------------------------
+	GLint getUniformLocation(UniformId id) const
+	{
+		return uniformLocations[id];
+	}
+	GLint getUniformLocation(const std::string& name) const
+	{
+		auto it = uniformCache.find(name);
+		if (it != uniformCache.end())
+			return it->second;
+		// only the first element of an array is listed by glGetActiveUniform, look the others up directly
+		if (name.find('[') != std::string::npos)
+			return glGetUniformLocation(ID, name.c_str());
+		return -1;
+	}
+	static const char* getUniformName(UniformId id)
+	{
+		static const char* names[UNIFORM_COUNT] = {
+			"model", "normalMat", "proj", "view", "viewPos", "light.diffuse", "light.position",
+			"material.shininess", "material.specularSet", "color", "ortho", "render_offset", "text_diffuse",
+			"material.texture_diffuse1", "material.texture_diffuse2", "material.texture_diffuse3", "material.texture_diffuse4",
+			"material.texture_specular1", "material.texture_specular2", "material.texture_specular3", "material.texture_specular4",
+			"material.texture_normal1", "material.texture_normal2", "material.texture_normal3", "material.texture_normal4",
+			"material.texture_height1", "material.texture_height2", "material.texture_height3", "material.texture_height4"
+		};
+		return names[id];
+	}
+	// per-instance vertex attributes, -1 if the vertex shader does not declare them
+	// a shader with "in mat4 instanceModel" is drawn instanced by the render queue and takes its model matrix from the attribute
+	GLint getInstanceModelAttrib() const
+	{
+		return instanceModelAttrib;
+	}
+	GLint getInstanceNormalAttrib() const
+	{
+		return instanceNormalAttrib;
+	}
+	bool isInstanced() const
+	{
+		return instanceModelAttrib >= 0;
+	}
+	// handle based setters, no string lookup and no GL error query (unused uniforms resolve to -1 which GL ignores)
+	// ------------------------------------------------------------------------
+	void setBool(UniformId id, bool value) const
+	{
+		glUniform1i(uniformLocations[id], (int)value);
+	}
+	void setInt(UniformId id, int value) const
+	{
+		glUniform1i(uniformLocations[id], value);
+	}
+	void setFloat(UniformId id, float value) const
+	{
+		glUniform1f(uniformLocations[id], value);
+	}
+	void setVec3(UniformId id, const glm::vec3& value) const
+	{
+		glUniform3fv(uniformLocations[id], 1, &value[0]);
+	}
+	void setVec3(UniformId id, float x, float y, float z) const
+	{
+		glUniform3f(uniformLocations[id], x, y, z);
+	}
+	void setMat3(UniformId id, const glm::mat3& mat) const
+	{
+		glUniformMatrix3fv(uniformLocations[id], 1, GL_FALSE, &mat[0][0]);
+	}
+	void setMat4(UniformId id, const glm::mat4& mat) const
+	{
+		glUniformMatrix4fv(uniformLocations[id], 1, GL_FALSE, &mat[0][0]);
+	}
 	// utility uniform functions
 	// ------------------------------------------------------------------------
 	void setBool(const std::string& name, bool value) const
 	{
-		glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+		glUniform1i(getUniformLocation(name), (int)value);
 		if (!GLErrorLogger::CheckGL())
 		{
 			printf("Error setBool shd Name %s for name %s", this->Name.c_str(), name.c_str());
@@ -134,7 +246,7 @@ public:
 	// ------------------------------------------------------------------------
 	void setInt(const std::string& name, int value) const
 	{
-		glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+		glUniform1i(getUniformLocation(name), value);
 		if (!GLErrorLogger::CheckGL())
 		{
 			printf("Error setInt shd Name %s for name %s", this->Name.c_str(), name.c_str());
@@ -143,7 +255,7 @@ public:
 	// ------------------------------------------------------------------------
 	void setFloat(const std::string& name, float value) const
 	{
-		glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+		glUniform1f(getUniformLocation(name), value);
 		if (!GLErrorLogger::CheckGL())
 		{
 			printf("Error setFloat shd Name %s for name %s", this->Name.c_str(), name.c_str());
@@ -152,7 +264,7 @@ public:
 	// ------------------------------------------------------------------------
 	void setVec2(const std::string& name, const glm::vec2& value) const
 	{
-		glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+		glUniform2fv(getUniformLocation(name), 1, &value[0]);
 		if (!GLErrorLogger::CheckGL())
 		{
 			printf("Error setVec2 shd Name %s for name %s", this->Name.c_str(), name.c_str());
@@ -160,7 +272,7 @@ public:
 	}
 	void setVec2(const std::string& name, float x, float y) const
 	{
-		glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+		glUniform2f(getUniformLocation(name), x, y);
 		if (!GLErrorLogger::CheckGL())
 		{
 			printf("Error setVec2 shd Name %s for name %s", this->Name.c_str(), name.c_str());
@@ -169,7 +281,7 @@ public:
 	// ------------------------------------------------------------------------
 	void setVec3(const std::string& name, const glm::vec3& value) const
 	{
-		glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+		glUniform3fv(getUniformLocation(name), 1, &value[0]);
 		if (!GLErrorLogger::CheckGL())
 		{
 			printf("Error setVec3 shd Name %s for name %s", this->Name.c_str(), name.c_str());
@@ -177,7 +289,7 @@ public:
 	}
 	void setVec3(const std::string& name, float x, float y, float z) const
 	{
-		glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+		glUniform3f(getUniformLocation(name), x, y, z);
 		if (!GLErrorLogger::CheckGL())
 		{
 			printf("Error setVec3 shd Name %s for name %s", this->Name.c_str(), name.c_str());
@@ -186,15 +298,15 @@ public:
 	// ------------------------------------------------------------------------
 	void setVec4(const std::string& name, const glm::vec4& value) const
 	{
-		glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+		glUniform4fv(getUniformLocation(name), 1, &value[0]);
 		if (!GLErrorLogger::CheckGL())
 		{
 			printf("Error setVec4 shd Name %s for name %s", this->Name.c_str(), name.c_str());
 		}
 	}
-	void setVec4(const std::string& name, float x, float y, float z, float w)
+	void setVec4(const std::string& name, float x, float y, float z, float w) const
 	{
-		glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+		glUniform4f(getUniformLocation(name), x, y, z, w);
 		if (!GLErrorLogger::CheckGL())
 		{
 			printf("Error setVec4 shd Name %s for name %s", this->Name.c_str(), name.c_str());
@@ -203,7 +315,7 @@ public:
 	// ------------------------------------------------------------------------
 	void setMat2(const std::string& name, const glm::mat2& mat) const
 	{
-		glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+		glUniformMatrix2fv(getUniformLocation(name), 1, GL_FALSE, &mat[0][0]);
 		if (!GLErrorLogger::CheckGL())
 		{
 			printf("Error setMat2 shd Name %s for name %s", this->Name.c_str(), name.c_str());
@@ -212,7 +324,7 @@ public:
 	// ------------------------------------------------------------------------
 	void setMat3(const std::string& name, const glm::mat3& mat) const
 	{
-		glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]); 
+		glUniformMatrix3fv(getUniformLocation(name), 1, GL_FALSE, &mat[0][0]); 
 		if (!GLErrorLogger::CheckGL())
 		{
 			printf("Error setMat3 shd Name %s for name %s", this->Name.c_str(), name.c_str());
@@ -221,7 +333,7 @@ public:
 	// ------------------------------------------------------------------------
 	void setMat4(const std::string& name, const glm::mat4& mat) const
 	{
-		glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+		glUniformMatrix4fv(getUniformLocation(name), 1, GL_FALSE, &mat[0][0]);
 		if (!GLErrorLogger::CheckGL())
 		{
 			printf("Error setMat4 shd Name %s for name %s", this->Name.c_str(), name.c_str());
@@ -229,6 +341,49 @@ public:
 	}
 
 private:
+	GLint uniformLocations[UNIFORM_COUNT];
+	std::unordered_map<std::string, GLint> uniformCache;
+	GLint instanceModelAttrib;
+	GLint instanceNormalAttrib;
+
+	// query every active uniform of the linked program once
+	// ------------------------------------------------------------------------
+	void cacheUniforms()
+	{
+		uniformCache.clear();
+
+		GLint count = 0;
+		GLint maxLength = 0;
+		glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+		glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+		std::vector<GLchar> nameBuffer(maxLength > 0 ? maxLength : 1);
+		for (GLint i = 0; i < count; i++)
+		{
+			GLsizei length = 0;
+			GLint size = 0;
+			GLenum type = 0;
+			glGetActiveUniform(ID, (GLuint)i, maxLength, &length, &size, &type, nameBuffer.data());
+
+			std::string name(nameBuffer.data(), length);
+			GLint location = glGetUniformLocation(ID, name.c_str());
+
+			// arrays are reported as name[0], make them reachable by their plain name too
+			size_t bracket = name.find("[0]");
+			if (bracket != std::string::npos)
+				uniformCache[name.substr(0, bracket)] = location;
+			uniformCache[name] = location;
+		}
+
+		for (int i = 0; i < UNIFORM_COUNT; i++)
+		{
+			uniformLocations[i] = getUniformLocation(getUniformName((UniformId)i));
+		}
+
+		instanceModelAttrib = glGetAttribLocation(ID, "instanceModel");
+		instanceNormalAttrib = glGetAttribLocation(ID, "instanceNormalMat");
+	}
+
 	// utility function for checking shader compilation/linking errors.
 	// ------------------------------------------------------------------------
 	void checkCompileErrors(GLuint shader, std::string type)
@@ -6,7 +6,7 @@ namespace fs = std::filesystem;
 
 ShaderLibrary* ShaderLibrary::libInstance = 0;
 
-ShaderLibrary::ShaderLibrary() { }
+ShaderLibrary::ShaderLibrary() : frameDataUBO(0) { }
 
 bool ShaderLibrary::LoadShaders()
 {
@@ -38,15 +38,48 @@ bool ShaderLibrary::LoadShaders()
 		}
 	}
 
+	CreateFrameDataBuffer();
+
 	return true;
 }
 
+void ShaderLibrary::CreateFrameDataBuffer()
+{
+	glGenBuffers(1, &frameDataUBO);
+	glBindBuffer(GL_UNIFORM_BUFFER, frameDataUBO);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameData), NULL, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	glBindBufferBase(GL_UNIFORM_BUFFER, FrameDataBinding, frameDataUBO);
+
+	legacyShaders.clear();
+	for (auto it = loadedShaders.begin(); it != loadedShaders.end(); ++it)
+	{
+		GLuint blockIndex = glGetUniformBlockIndex((*it)->ID, "FrameData");
+		if (blockIndex != GL_INVALID_INDEX)
+		{
+			glUniformBlockBinding((*it)->ID, blockIndex, FrameDataBinding);
+		}
+		else
+		{
+			legacyShaders.push_back(*it);
+		}
+	}
+}
+
 void ShaderLibrary::UnloadShaders()
 {
 	for (auto it = loadedShaders.begin(); it != loadedShaders.end(); ++it)
 	{
 		delete* it;
 	}
+	loadedShaders.clear();
+	legacyShaders.clear();
+
+	if (frameDataUBO != 0)
+	{
+		glDeleteBuffers(1, &frameDataUBO);
+		frameDataUBO = 0;
+	}
 }
 
 Shader* ShaderLibrary::GetShader(const std::string& shaderName)
@@ -74,33 +107,56 @@ void ShaderLibrary::SetShaderPath(const std::string& path)
 	shadersPath = path;
 }
 
+// one buffer upload for every shader with the FrameData block, the rest fall back to per-program uniforms
+void ShaderLibrary::SetFrameData(const glm::mat4& proj, const glm::mat4& view, const glm::vec3& lightPos, const glm::vec3& diffuse, const glm::vec3& viewPos, float time)
+{
+	FrameData data;
+	data.proj = proj;
+	data.view = view;
+	data.skyboxView = glm::mat4(glm::mat3(view));
+	data.lightPosition = glm::vec4(lightPos, 1.0f);
+	data.lightDiffuse = glm::vec4(diffuse, 1.0f);
+	data.viewPos = glm::vec4(viewPos, 1.0f);
+	data.time = time;
+
+	glBindBuffer(GL_UNIFORM_BUFFER, frameDataUBO);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameData), &data);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	if (legacyShaders.empty())
+		return;
+
+	SetPVGlobal(proj, view);
+	SetGlobalLight(lightPos, diffuse, viewPos);
+}
+
 void ShaderLibrary::SetPVGlobal(const glm::mat4& proj, const glm::mat4& view)
 {
-	for (auto it = loadedShaders.begin(); it != loadedShaders.end(); ++it)
+	for (auto it = legacyShaders.begin(); it != legacyShaders.end(); ++it)
 	{
 		(*it)->use();
-		(*it)->setMat4("proj", proj);
+		(*it)->setMat4(Shader::UNIFORM_PROJ, proj);
 
 		if ((*it)->Name == "skybox")
 		{
 			glm::mat4 view2 = glm::mat4(glm::mat3(view));
 
-			(*it)->setMat4("view", view2);
+			(*it)->setMat4(Shader::UNIFORM_VIEW, view2);
 		}
 		else
 		{
-			(*it)->setMat4("view", view);
+			(*it)->setMat4(Shader::UNIFORM_VIEW, view);
 		}
 	}
 }
 
 void ShaderLibrary::SetGlobalLight(const glm::vec3& pos, const glm::vec3& diffuse, const glm::vec3& viewPos)
 {
-	for (auto it = loadedShaders.begin(); it != loadedShaders.end(); ++it)
+	for (auto it = legacyShaders.begin(); it != legacyShaders.end(); ++it)
 	{
 		(*it)->use();
-		(*it)->setVec3("light.diffuse", diffuse);
-		(*it)->setVec3("light.position", pos);
-		(*it)->setVec3("viewPos", viewPos);
+		(*it)->setVec3(Shader::UNIFORM_LIGHT_DIFFUSE, diffuse);
+		(*it)->setVec3(Shader::UNIFORM_LIGHT_POSITION, pos);
+		(*it)->setVec3(Shader::UNIFORM_VIEW_POS, viewPos);
 	}
 }
\ No newline at end of file
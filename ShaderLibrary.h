@@ -6,12 +6,43 @@
 #include <vector>
 #include "Shader.h"
 
+// per-frame state shared by every shader, uploaded once per frame into a std140 uniform buffer
+// shaders pick it up by declaring the matching block, it is bound to FrameDataBinding automatically on load:
+//
+//	layout (std140) uniform FrameData
+//	{
+//		mat4 proj;
+//		mat4 view;
+//		mat4 skyboxView;
+//		vec4 lightPosition;
+//		vec4 lightDiffuse;
+//		vec4 viewPos;
+//		float time;
+//	};
+//
+// shaders without the block still get proj/view/light/viewPos as plain uniforms
+struct FrameData
+{
+	glm::mat4 proj;
+	glm::mat4 view;
+	glm::mat4 skyboxView;
+	glm::vec4 lightPosition;
+	glm::vec4 lightDiffuse;
+	glm::vec4 viewPos;
+	float time;
+	float padding[3];
+};
+
 class ShaderLibrary
 {
 public:
+	static const GLuint FrameDataBinding = 0;
+
 	bool LoadShaders();
 	void UnloadShaders();
 
+	void SetFrameData(const glm::mat4& proj, const glm::mat4& view, const glm::vec3& lightPos, const glm::vec3& diffuse, const glm::vec3& viewPos, float time);
+
 	void SetPVGlobal(const glm::mat4& proj, const glm::mat4& view);
 	void SetGlobalLight(const glm::vec3& pos, const glm::vec3& diffuse, const glm::vec3& viewPos);
 
@@ -24,8 +55,14 @@ private:
 	ShaderLibrary();
 
 	std::vector<Shader*> loadedShaders;
+	// shaders without the FrameData block, they still need per-program uploads
+	std::vector<Shader*> legacyShaders;
 	std::string shadersPath;
 
+	GLuint frameDataUBO;
+
+	void CreateFrameDataBuffer();
+
 	static ShaderLibrary* libInstance;
 };
 #endif
\ No newline at end of file
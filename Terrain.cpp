@@ -1,10 +1,12 @@
 #include "Terrain.h"
 #include "ShaderLibrary.h"
+#include "RenderQueue.h"
+#include "MeshOptimizer.h"
 
 Terrain::Terrain(glm::vec2 startPoint, int size)
 	: ModelNode("terrain")
 {
-	m = GenerateTerrain(startPoint, size);
+	m = std::make_shared<Model>(GenerateTerrain(startPoint, size));
 	sdr = ShaderLibrary::GetInstance()->GetShader("terrain");
 }
 
@@ -12,10 +14,7 @@ void Terrain::Shoot(const glm::vec3& orig, const glm::vec3& dir) { }
 
 void Terrain::Visualize(const glm::mat4& transform)
 {
-	sdr->use();
-	sdr->setMat4("model", transform);
-
-	m.Draw(*sdr);
+	RenderQueue::GetInstance()->Submit(sdr, *m, transform, NULL);
 }
 
 bool Terrain::IsWithinBounds(const glm::vec3& point, const glm::vec2& startPoint, int size)
@@ -108,7 +107,10 @@ Model Terrain::GenerateTerrain(glm::vec2 startPoint, int size)
 
 	textures_m.push_back(tex);
 
-	Mesh modelMesh(vertices, indices, textures_m);
+	// row-major quads only reuse the previous row, reorder for the post-transform cache
+	MeshOptimizer::Optimize(vertices, indices);
+
+	Mesh modelMesh(std::move(vertices), std::move(indices), std::move(textures_m));
 	Model terrainModel;
 
 	terrainModel.meshes.push_back(modelMesh);
@@ -0,0 +1,302 @@
+#include "TransformHierarchy.h"
+#include "SceneNode.h"
+#include "Profiler.h"
+#include <glm/gtc/matrix_transform.hpp>
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1) || defined(__SSE__)
+#include <xmmintrin.h>
+#define TRANSFORM_SSE
+#endif
+
+TransformHierarchy* TransformHierarchy::hierarchyInstance = 0;
+
+TransformHierarchy::TransformHierarchy() : anyDirty(false), topologyChanged(false), versionCounter(0), rebuildStamp(0) { }
+
+TransformHierarchy* TransformHierarchy::GetInstance()
+{
+	if (!hierarchyInstance)
+		hierarchyInstance = new TransformHierarchy;
+	return hierarchyInstance;
+}
+
+int TransformHierarchy::Add(TransformNode* node)
+{
+	int slot = (int)nodes.size();
+
+	nodes.push_back(node);
+	parents.push_back(-1);
+	translations.push_back(glm::vec3(0.0f));
+	scales.push_back(glm::vec3(1.0f));
+	rotationAxes.push_back(glm::vec3(0.0f));
+	rotationAxes2.push_back(glm::vec3(0.0f));
+	angles.push_back(0.0f);
+	angles2.push_back(0.0f);
+	locals.push_back(glm::mat4(1.0f));
+	worlds.push_back(glm::mat4(1.0f));
+	normals.push_back(glm::mat3(1.0f));
+	versions.push_back(NextVersion());
+	localDirty.push_back(1);
+	worldChanged.push_back(0);
+	visitStamp.push_back(0);
+
+	anyDirty = true;
+	topologyChanged = true;
+	return slot;
+}
+
+template <typename T>
+static void EraseSlot(std::vector<T>& v, int slot)
+{
+	v.erase(v.begin() + slot);
+}
+
+void TransformHierarchy::Remove(int slot)
+{
+	EraseSlot(nodes, slot);
+	EraseSlot(parents, slot);
+	EraseSlot(translations, slot);
+	EraseSlot(scales, slot);
+	EraseSlot(rotationAxes, slot);
+	EraseSlot(rotationAxes2, slot);
+	EraseSlot(angles, slot);
+	EraseSlot(angles2, slot);
+	EraseSlot(locals, slot);
+	EraseSlot(worlds, slot);
+	EraseSlot(normals, slot);
+	EraseSlot(versions, slot);
+	EraseSlot(localDirty, slot);
+	EraseSlot(worldChanged, slot);
+	EraseSlot(visitStamp, slot);
+
+	// keep the handles and parent links valid until the rebuild, children of the removed slot are parentless for now
+	for (int i = slot; i < (int)nodes.size(); i++)
+		nodes[i]->SetSlot(i);
+	for (int i = 0; i < (int)parents.size(); i++)
+	{
+		if (parents[i] == slot)
+			parents[i] = -1;
+		else if (parents[i] > slot)
+			parents[i]--;
+	}
+
+	anyDirty = true;
+	topologyChanged = true;
+}
+
+void TransformHierarchy::MarkTopologyChanged()
+{
+	topologyChanged = true;
+}
+
+uint32_t TransformHierarchy::NextVersion()
+{
+	// 0 is the root and 0xFFFFFFFF means never transformed, skip both on wrap around
+	if (++versionCounter == 0xFFFFFFFF)
+		versionCounter = 1;
+	return versionCounter;
+}
+
+void TransformHierarchy::MarkDirty(int slot)
+{
+	localDirty[slot] = 1;
+	anyDirty = true;
+}
+
+// only changed values invalidate the slot
+void TransformHierarchy::SetTranslation(int slot, const glm::vec3& trV)
+{
+	if (trV != translations[slot])
+	{
+		translations[slot] = trV;
+		MarkDirty(slot);
+	}
+}
+
+void TransformHierarchy::SetScale(int slot, const glm::vec3& scV)
+{
+	if (scV != scales[slot])
+	{
+		scales[slot] = scV;
+		MarkDirty(slot);
+	}
+}
+
+void TransformHierarchy::SetRotation(int slot, const glm::vec3& rotV, float angle)
+{
+	if (rotV != rotationAxes[slot] || angle != angles[slot])
+	{
+		rotationAxes[slot] = rotV;
+		angles[slot] = angle;
+		MarkDirty(slot);
+	}
+}
+
+void TransformHierarchy::SetRotation2(int slot, const glm::vec3& rotV, float angle)
+{
+	if (rotV != rotationAxes2[slot] || angle != angles2[slot])
+	{
+		rotationAxes2[slot] = rotV;
+		angles2[slot] = angle;
+		MarkDirty(slot);
+	}
+}
+
+void TransformHierarchy::SetRotationAngle(int slot, float angle)
+{
+	if (angle != angles[slot])
+	{
+		angles[slot] = angle;
+		MarkDirty(slot);
+	}
+}
+
+int TransformHierarchy::Visit(TransformNode* node, int parentSlot)
+{
+	int slot = node->GetSlot();
+	if (visitStamp[slot] == rebuildStamp)
+		return -1; // already reached through another path
+
+	visitStamp[slot] = rebuildStamp;
+	newOrder.push_back(slot);
+	newParents.push_back(parentSlot);
+	return (int)newOrder.size() - 1;
+}
+
+template <typename T>
+static void Permute(std::vector<T>& v, const std::vector<int>& order, std::vector<T>& scratch)
+{
+	scratch.resize(v.size());
+	for (size_t i = 0; i < order.size(); i++)
+		scratch[i] = v[order[i]];
+	v.swap(scratch);
+}
+
+void TransformHierarchy::Rebuild(SceneNode* root)
+{
+	newOrder.clear();
+	newParents.clear();
+	rebuildStamp++;
+
+	// depth first from the root gives parents before children
+	if (root != NULL)
+		root->TraverseTransforms(-1, *this);
+
+	// transforms not (yet) attached to the graph keep a slot at the end
+	for (int i = 0; i < (int)nodes.size(); i++)
+	{
+		if (visitStamp[i] != rebuildStamp)
+		{
+			visitStamp[i] = rebuildStamp;
+			newOrder.push_back(i);
+			newParents.push_back(-1);
+		}
+	}
+
+	{
+		std::vector<TransformNode*> s; Permute(nodes, newOrder, s);
+	}
+	{
+		std::vector<glm::vec3> s;
+		Permute(translations, newOrder, s);
+		Permute(scales, newOrder, s);
+		Permute(rotationAxes, newOrder, s);
+		Permute(rotationAxes2, newOrder, s);
+	}
+	{
+		std::vector<float> s;
+		Permute(angles, newOrder, s);
+		Permute(angles2, newOrder, s);
+	}
+	{
+		std::vector<glm::mat4> s;
+		Permute(locals, newOrder, s);
+		Permute(worlds, newOrder, s);
+	}
+	{
+		std::vector<glm::mat3> s; Permute(normals, newOrder, s);
+	}
+	{
+		std::vector<uint32_t> s; Permute(versions, newOrder, s);
+	}
+	parents = newParents;
+
+	// parents changed, every world matrix has to be rebuilt
+	for (int i = 0; i < (int)nodes.size(); i++)
+	{
+		nodes[i]->SetSlot(i);
+		localDirty[i] = 1;
+	}
+
+	topologyChanged = false;
+	anyDirty = true;
+}
+
+// out = a * b, column major like glm
+static inline void MultiplyMat4(const glm::mat4& a, const glm::mat4& b, glm::mat4& out)
+{
+#ifdef TRANSFORM_SSE
+	const float* pa = &a[0][0];
+	const float* pb = &b[0][0];
+	float* po = &out[0][0];
+
+	__m128 a0 = _mm_loadu_ps(pa);
+	__m128 a1 = _mm_loadu_ps(pa + 4);
+	__m128 a2 = _mm_loadu_ps(pa + 8);
+	__m128 a3 = _mm_loadu_ps(pa + 12);
+
+	for (int c = 0; c < 4; c++)
+	{
+		__m128 r = _mm_mul_ps(a0, _mm_set1_ps(pb[c * 4 + 0]));
+		r = _mm_add_ps(r, _mm_mul_ps(a1, _mm_set1_ps(pb[c * 4 + 1])));
+		r = _mm_add_ps(r, _mm_mul_ps(a2, _mm_set1_ps(pb[c * 4 + 2])));
+		r = _mm_add_ps(r, _mm_mul_ps(a3, _mm_set1_ps(pb[c * 4 + 3])));
+		_mm_storeu_ps(po + c * 4, r);
+	}
+#else
+	out = a * b;
+#endif
+}
+
+void TransformHierarchy::Update(SceneNode* root)
+{
+	if (topologyChanged)
+		Rebuild(root);
+
+	if (!anyDirty)
+		return;
+
+	PROFILE_ZONE("TransformHierarchy::Update");
+
+	int count = (int)nodes.size();
+	for (int i = 0; i < count; i++)
+	{
+		int parent = parents[i];
+		bool parentChanged = parent >= 0 && worldChanged[parent];
+
+		worldChanged[i] = localDirty[i] || parentChanged;
+		if (!worldChanged[i])
+			continue;
+
+		if (localDirty[i])
+		{
+			glm::mat4 local = glm::translate(glm::mat4(1.0f), translations[i]);
+			if (angles2[i] != 0.0f)
+				local = glm::rotate(local, angles2[i], rotationAxes2[i]);
+			if (angles[i] != 0.0f)
+				local = glm::rotate(local, angles[i], rotationAxes[i]);
+			locals[i] = glm::scale(local, scales[i]);
+			localDirty[i] = 0;
+		}
+
+		// stack matrices, same order the recursive traversal used
+		if (parent >= 0)
+			MultiplyMat4(locals[i], worlds[parent], worlds[i]);
+		else
+			worlds[i] = locals[i];
+
+		normals[i] = glm::transpose(glm::inverse(glm::mat3(worlds[i])));
+		versions[i] = NextVersion();
+	}
+
+	anyDirty = false;
+}
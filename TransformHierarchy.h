@@ -0,0 +1,91 @@
+#pragma once
+#ifndef TRANSFORMHIERARCHY_H
+#define TRANSFORMHIERARCHY_H
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <stdint.h>
+
+class SceneNode;
+class TransformNode;
+
+// the transforms of every TransformNode, stored as flat arrays (structure of arrays) in topological order
+// a parent always comes before its children, so the world matrices are brought up to date by one linear pass over the arrays
+// TransformNode only keeps its slot index, the scene graph keeps the draw/intersection structure
+//
+// the parent of a slot is the closest TransformNode above it, a TransformNode reachable through several paths
+// takes the parent of the first path found (the scene graph never shares transforms, only models)
+// slots without a TransformNode above them are in world space, the graph root is always visualized with the identity
+class TransformHierarchy
+{
+public:
+	static TransformHierarchy* GetInstance();
+
+	// new slot at the end, parentless until the next topology rebuild
+	int Add(TransformNode* node);
+	// drops the slot of a node being destroyed, the slots after it move down by one and the order is rebuilt by the next Update
+	void Remove(int slot);
+
+	// called when the scene graph is edited, the order is rebuilt by the next Update
+	void MarkTopologyChanged();
+
+	// recomputes the local matrices of changed slots and the world matrices below them, cheap when nothing moved
+	void Update(SceneNode* root);
+
+	// called by TransformNode::TraverseTransforms while the order is rebuilt, returns the new slot of node
+	int Visit(TransformNode* node, int parentSlot);
+
+	void SetTranslation(int slot, const glm::vec3& trV);
+	void SetScale(int slot, const glm::vec3& scV);
+	void SetRotation(int slot, const glm::vec3& rotV, float angle);
+	void SetRotation2(int slot, const glm::vec3& rotV, float angle);
+	void SetRotationAngle(int slot, float angle);
+
+	const glm::vec3& GetTranslation(int slot) const { return translations[slot]; }
+	float GetRotationAngle(int slot) const { return angles[slot]; }
+
+	const glm::mat4& GetWorld(int slot) const { return worlds[slot]; }
+	const glm::mat3& GetNormalMatrix(int slot) const { return normals[slot]; }
+	// changes whenever the world matrix of the slot is recomputed, never 0
+	uint32_t GetVersion(int slot) const { return versions[slot]; }
+private:
+	TransformHierarchy();
+
+	std::vector<TransformNode*> nodes;
+	std::vector<int> parents;
+
+	// local TRS, the matrix is translate * rotate2 * rotate * scale
+	std::vector<glm::vec3> translations;
+	std::vector<glm::vec3> scales;
+	std::vector<glm::vec3> rotationAxes;
+	std::vector<glm::vec3> rotationAxes2;
+	std::vector<float> angles;
+	std::vector<float> angles2;
+
+	std::vector<glm::mat4> locals;
+	std::vector<glm::mat4> worlds;
+	std::vector<glm::mat3> normals;
+	std::vector<uint32_t> versions;
+
+	std::vector<uint8_t> localDirty;
+	// set during Update for slots whose world matrix was recomputed, read by their children further down the pass
+	std::vector<uint8_t> worldChanged;
+
+	bool anyDirty;
+	bool topologyChanged;
+	uint32_t versionCounter;
+
+	// scratch for the rebuild
+	std::vector<int> newOrder;
+	std::vector<int> newParents;
+	std::vector<int> visitStamp;
+	int rebuildStamp;
+
+	void Rebuild(SceneNode* root);
+	void MarkDirty(int slot);
+	uint32_t NextVersion();
+
+	static TransformHierarchy* hierarchyInstance;
+};
+
+#endif
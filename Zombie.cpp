@@ -1,13 +1,15 @@
 #include "Zombie.h"
 #include "ZombieNode.h"
 #include <cmath>
+#include <glm/gtc/constants.hpp>
+#include "Profiler.h"
 
 Zombie::Zombie(TransformNode* trN, Player* n, BulletEngine* bulletEngine)
 {
 	transformN = trN;
 	player = n;
 
-	zombiePos = trN->translateVector;
+	zombiePos = trN->GetTranslation();
 	zombiePos.y += 1.0f;
 	forwardVector = n->camera->pos - zombiePos;
 	rotationalVector = forwardVector;
@@ -15,7 +17,8 @@ Zombie::Zombie(TransformNode* trN, Player* n, BulletEngine* bulletEngine)
 	health = 15;
 
 	fixedYaw = -110.0 - YAW;
-	fixedRot = trN->rotateAngleRad;
+	fixedRot = trN->GetRotationAngle();
+	previousRotation = currentRotation = trN->GetRotationAngle();
 
 	shootYaw = 0.0f;
 
@@ -41,6 +44,8 @@ int Zombie::GetHealth()
 
 void Zombie::Update(float delta)
 {
+	PROFILE_ZONE("Zombie::Update");
+
 	if (health <= 0)
 		return;
 
@@ -77,28 +82,52 @@ void Zombie::Update(float delta)
 
 	angle = acos(angle);
 
+	float rotation = 0.0f;
 	if (hand.y >= 0.001f)
 	{
-		transformN->rotateAngleRad = angle;
+		rotation = angle;
 		shootYaw = -glm::degrees(angle);
 	}
 	else if (hand.y < 0.001f)
 	{
-		transformN->rotateAngleRad = -angle;
+		rotation = -angle;
 		shootYaw = glm::degrees(angle); //
 	}
 
 	forwardVector = currentVector; 
 
-	transformN->rotateAngleRad += fixedRot;
+	rotation += fixedRot;
 	shootYaw += fixedYaw;
 
+	transformN->SetRotationAngle(rotation);
+	currentRotation = rotation;
+
 	//printf("%f\n", angle);
 	
 }
 
+void Zombie::SavePreviousState()
+{
+	previousRotation = currentRotation;
+	// the simulation works on the simulated pose, not the interpolated one left over from rendering
+	transformN->SetRotationAngle(currentRotation);
+}
+
+void Zombie::Interpolate(float alpha)
+{
+	// blend along the shorter arc so crossing +-pi doesn't spin the zombie the long way round
+	float diff = currentRotation - previousRotation;
+	const float pi = glm::pi<float>();
+	while (diff > pi)
+		diff -= 2.0f * pi;
+	while (diff < -pi)
+		diff += 2.0f * pi;
+
+	transformN->SetRotationAngle(previousRotation + diff * alpha);
+}
+
 void Zombie::Shoot()
 {
 	glm::vec3 normalizedDir = glm::normalize(previousForwardVector);
-	bulletEngine->Shoot(normalizedDir, zombiePos, shootYaw, 0.0f);
+	bulletEngine->Shoot(normalizedDir, zombiePos, shootYaw, 0.0f, zombieN);
 }
\ No newline at end of file
@@ -15,6 +15,10 @@ public:
 	void Update(float delta);
 	void SetSceneNode(ZombieNode* zNode);
 
+	// fixed step interpolation, SavePreviousState before a tick and Interpolate before rendering
+	void SavePreviousState();
+	void Interpolate(float alpha);
+
 	void DecreaseHealth();
 	int GetHealth();
 private:
@@ -35,6 +39,10 @@ private:
 	float fixedRot = 0.0f;
 	float fixedYaw = 0.0f;
 
+	// simulated rotation after the previous and the current tick, the transform node holds the rendered blend of the two
+	float previousRotation = 0.0f;
+	float currentRotation = 0.0f;
+
 	glm::vec3 forwardVector;
 	glm::vec3 previousForwardVector;
 	glm::vec3 rotationalVector;
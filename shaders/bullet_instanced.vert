@@ -0,0 +1,21 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+
+// one draw for every bullet in flight, BulletEngine streams the model matrices into this attribute
+layout (location = 5) in mat4 instanceModel;
+
+layout (std140) uniform FrameData
+{
+	mat4 proj;
+	mat4 view;
+	mat4 skyboxView;
+	vec4 lightPosition;
+	vec4 lightDiffuse;
+	vec4 viewPos;
+	float time;
+};
+
+void main()
+{
+	gl_Position = proj * view * instanceModel * vec4(aPos, 1.0);
+}